@@ -351,7 +351,6 @@ void as_append_cstr(a_string* s, const char* n) {
         s->data[s->len++] = n[i];
     }
     s->data[s->len] = '\0'; // null terminate it
-    s->len += new_len;
 }
 
 void as_append_astr(a_string* s, const a_string* n) {
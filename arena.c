@@ -0,0 +1,125 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "common.h"
+
+#define AR_ALIGN      _Alignof(max_align_t)
+#define AR_BLOCK_SIZE (64 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock* prev;
+    usize cap;
+    usize used;
+    _Alignas(max_align_t) u8 data[];
+};
+
+static ArenaBlock* ar_block_new(ArenaBlock* prev, usize cap) {
+    ArenaBlock* b = malloc(sizeof(ArenaBlock) + cap);
+    check_alloc(b);
+    *b = (ArenaBlock){.prev = prev, .cap = cap};
+    return b;
+}
+
+void* ar_alloc(Arena* a, usize size) {
+    size = (size + AR_ALIGN - 1) & ~(AR_ALIGN - 1);
+
+    ArenaBlock* b = a->head;
+    if (!b || b->cap - b->used < size) {
+        // each block is twice as big as the last, so there are only ever a
+        // handful of them
+        usize cap = b ? b->cap * 2 : AR_BLOCK_SIZE;
+        while (cap < size)
+            cap *= 2;
+
+        b = a->head = ar_block_new(b, cap);
+    }
+
+    void* res = &b->data[b->used];
+    b->used += size;
+    return res;
+}
+
+void* ar_copy(Arena* a, const void* src, usize size) {
+    void* res = ar_alloc(a, size);
+    if (size)
+        memcpy(res, src, size);
+    return res;
+}
+
+ArenaMark ar_mark(const Arena* a) {
+    return (ArenaMark){a->head, a->head ? a->head->used : 0};
+}
+
+void ar_rewind(Arena* a, ArenaMark mark) {
+    if (!mark.block) {
+        ar_reset(a);
+        return;
+    }
+
+    while (a->head != mark.block) {
+        ArenaBlock* prev = a->head->prev;
+        free(a->head);
+        a->head = prev;
+    }
+
+    a->head->used = mark.used;
+}
+
+void ar_reset(Arena* a) {
+    if (!a->head)
+        return;
+
+    // the newest block is usually the largest
+    ArenaBlock* b = a->head->prev;
+    while (b) {
+        ArenaBlock* prev = b->prev;
+        free(b);
+        b = prev;
+    }
+
+    a->head->prev = NULL;
+    a->head->used = 0;
+}
+
+void ar_adopt(Arena* a, Arena* other) {
+    if (!other->head)
+        return;
+
+    if (!a->head) {
+        *a = *other;
+        *other = (Arena){0};
+        return;
+    }
+
+    // a keeps allocating from its newest block, and the adopted blocks go
+    // right behind it
+    ArenaBlock* oldest = other->head;
+    while (oldest->prev)
+        oldest = oldest->prev;
+
+    oldest->prev = a->head->prev;
+    a->head->prev = other->head;
+    *other = (Arena){0};
+}
+
+void ar_free(Arena* a) {
+    ArenaBlock* b = a->head;
+    while (b) {
+        ArenaBlock* prev = b->prev;
+        free(b);
+        b = prev;
+    }
+
+    *a = (Arena){0};
+}
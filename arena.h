@@ -0,0 +1,44 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include "common.h"
+
+typedef struct ArenaBlock ArenaBlock;
+
+// a bump allocator. nothing in it is freed on its own, only everything at
+// once, or everything since a mark. a zeroed arena is a valid empty one.
+typedef struct {
+    ArenaBlock* head; // the newest block, which is allocated from
+} Arena;
+
+// everything allocated after it can be thrown away with ar_rewind
+typedef struct {
+    ArenaBlock* block;
+    usize used;
+} ArenaMark;
+
+// aligned for any type. never returns NULL.
+void* ar_alloc(Arena* a, usize size);
+// copies size bytes into the arena
+void* ar_copy(Arena* a, const void* src, usize size);
+
+ArenaMark ar_mark(const Arena* a);
+// frees everything allocated since mark was taken
+void ar_rewind(Arena* a, ArenaMark mark);
+// frees everything, but keeps the newest block around to be reused
+void ar_reset(Arena* a);
+// moves every block of other into a, leaving other empty. whatever was
+// allocated from other stays valid until a is rewound past it or freed.
+void ar_adopt(Arena* a, Arena* other);
+void ar_free(Arena* a);
+
+#endif // _ARENA_H
@@ -11,9 +11,12 @@
 
 #include "ast.h"
 #include "a_string.h"
+#include "a_vector.h"
+#include "arena.h"
 #include "common.h"
+#include "hashtab.h"
 #include <stdlib.h> // macro
-#include <string.h> // macro
+#include <string.h>
 
 static const char* EXPR_KIND_STRINGS[] = {
     [CB_EXPR_LIT] = "lit",
@@ -90,92 +93,298 @@ CB_Value cb_value_new_char(char chr) {
     return (CB_Value){.kind = CB_PRIM_CHAR, .chr = chr};
 }
 
-CB_Value cb_value_new_string(a_string s) {
-    a_string ns = as_dupe(&s);
+CB_Value cb_value_new_string(Arena* a, a_string s) {
+    char* data = ar_alloc(a, s.len + 1);
+    memcpy(data, s.data, s.len);
+    data[s.len] = '\0';
+    return cb_value_new_arena_string(data, s.len);
+}
+
+CB_Value cb_value_new_arena_string(char* data, usize len) {
     return (CB_Value){
         .kind = CB_PRIM_STRING,
-        .string.data = ns.data,
-        .string.len = ns.len,
+        .string.data = data,
+        .string.len = len,
     };
 }
 
-void cb_value_free(CB_Value* v) {
-    switch (v->kind) {
-        case CB_PRIM_STRING: {
-            free((void*)v->string.data);
-        } break;
-        default: break;
+#define CB_EXPRS_INITIAL       256
+#define CB_EXPRS_INITIAL_SLOTS 256
+
+static void cb_exprs_grow(CB_Exprs* xs) {
+    xs->cap = xs->cap ? xs->cap * 2 : CB_EXPRS_INITIAL;
+    xs->kinds = realloc(xs->kinds, xs->cap * sizeof(u8));
+    check_alloc(xs->kinds);
+    xs->pos = realloc(xs->pos, xs->cap * sizeof(Pos));
+    check_alloc(xs->pos);
+    xs->data = realloc(xs->data, xs->cap * sizeof(CB_ExprData));
+    check_alloc(xs->data);
+
+    if (xs->same) {
+        xs->same = realloc(xs->same, xs->cap * sizeof(CB_ExprId));
+        check_alloc(xs->same);
     }
 }
 
-CB_Expr cb_expr_new_literal(Pos pos, CB_Value v) {
-    return (CB_Expr){
-        .kind = CB_EXPR_LIT,
-        .pos = pos,
-        .lit = v,
-    };
+// FNV-1a, continued from h
+static u32 cb_hash(u32 h, const void* data, usize len) {
+    const u8* p = data;
+    for (usize i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
 }
 
-CB_Expr cb_expr_new_ident(Pos pos, a_string s) {
-    return (CB_Expr){
-        .kind = CB_EXPR_IDENT,
-        .pos = pos,
-        .ident = as_dupe(&s),
-    };
+// hashes everything cb_expr_equal compares
+static u32 cb_expr_hash(const CB_Exprs* xs, CB_ExprId e) {
+    u8 k = xs->kinds[e];
+    CB_ExprData d = xs->data[e];
+    u32 h = cb_hash(2166136261u, &k, 1);
+
+    if (k == CB_EXPR_LIT) {
+        const CB_Value* v = cb_expr_lit(xs, e);
+        h = cb_hash(h, &v->kind, sizeof(v->kind));
+        switch (v->kind) {
+            case CB_PRIM_INTEGER: return cb_hash(h, &v->integer, 8);
+            case CB_PRIM_REAL: return cb_hash(h, &v->real, 8);
+            case CB_PRIM_BOOLEAN: return cb_hash(h, &v->boolean, 1);
+            case CB_PRIM_CHAR: return cb_hash(h, &v->chr, 1);
+            case CB_PRIM_STRING:
+                return cb_hash(h, v->string.data, v->string.len);
+            default: return h;
+        }
+    } else if (k == CB_EXPR_IDENT) {
+        return cb_hash(h, &d.ident, sizeof(Atom));
+    } else if (cb_expr_kind_is_unary(k)) {
+        return cb_hash(h, &xs->same[d.unary], sizeof(CB_ExprId));
+    }
+
+    h = cb_hash(h, &xs->same[d.lhs], sizeof(CB_ExprId));
+    return cb_hash(h, &xs->same[d.rhs], sizeof(CB_ExprId));
+}
+
+static bool cb_value_equal(const CB_Value* a, const CB_Value* b) {
+    if (a->kind != b->kind)
+        return false;
+
+    switch (a->kind) {
+        case CB_PRIM_INTEGER: return a->integer == b->integer;
+        // bit for bit, so that 0.0 and -0.0 stay apart
+        case CB_PRIM_REAL: return memcmp(&a->real, &b->real, 8) == 0;
+        case CB_PRIM_BOOLEAN: return a->boolean == b->boolean;
+        case CB_PRIM_CHAR: return a->chr == b->chr;
+        case CB_PRIM_STRING:
+            return a->string.len == b->string.len &&
+                   memcmp(a->string.data, b->string.data, a->string.len) == 0;
+        default: return true;
+    }
+}
+
+// the operands are compared by their same ids, so that equal trees are found
+// without walking them
+static bool cb_expr_equal(const CB_Exprs* xs, CB_ExprId a, CB_ExprId b) {
+    u8 k = xs->kinds[a];
+    if (k != xs->kinds[b])
+        return false;
+
+    CB_ExprData da = xs->data[a], db = xs->data[b];
+    if (k == CB_EXPR_LIT)
+        return cb_value_equal(cb_expr_lit(xs, a), cb_expr_lit(xs, b));
+    else if (k == CB_EXPR_IDENT)
+        return da.ident == db.ident;
+    else if (cb_expr_kind_is_unary(k))
+        return xs->same[da.unary] == xs->same[db.unary];
+
+    return xs->same[da.lhs] == xs->same[db.lhs] &&
+           xs->same[da.rhs] == xs->same[db.rhs];
+}
+
+// works out the same id of a new node
+static void cb_expr_share(CB_Exprs* xs, CB_ExprId e) {
+    xs->same[e] = e;
+    // a call can be equal to another and still give something else back.
+    // its parents are never equal to anything either, since no other node
+    // has it as an operand.
+    if (!cb_expr_kind_is_pure(xs->kinds[e]))
+        return;
+
+    HashTable* t = &xs->slots;
+    u32 hash = cb_expr_hash(xs, e);
+    u32 i = ht_start(t, hash);
+    for (; !ht_empty(t, i); i = ht_next(t, i)) {
+        CB_ExprId other = ht_id(t, i);
+        if (ht_hash(t, i) == hash && cb_expr_equal(xs, other, e)) {
+            xs->same[e] = other;
+            return;
+        }
+    }
+
+    ht_insert(t, i, hash, e);
 }
 
-CB_Expr cb_expr_new_unary(Pos pos, CB_ExprKind k, CB_Expr operand) {
-    dupe(CB_Expr, n, operand);
-    return (CB_Expr){k, .pos = pos, .unary = n};
+// takes a node that is the first of its kind back out of the table
+static void cb_expr_unshare(CB_Exprs* xs, CB_ExprId e) {
+    if (xs->same[e] != e || !cb_expr_kind_is_pure(xs->kinds[e]))
+        return;
+
+    HashTable* t = &xs->slots;
+    u32 i = ht_start(t, cb_expr_hash(xs, e));
+    while (ht_id(t, i) != e)
+        i = ht_next(t, i);
+    ht_remove(t, i);
 }
 
-CB_Expr cb_expr_new_binary(Pos pos, CB_ExprKind k, CB_Expr lhs, CB_Expr rhs) {
-    dupe(CB_Expr, nlhs, lhs);
-    dupe(CB_Expr, nrhs, rhs);
-    return (CB_Expr){k, .pos = pos, .lhs = nlhs, .rhs = nrhs};
+static CB_ExprId cb_expr_push(CB_Exprs* xs, CB_ExprKind k, Pos pos,
+                              CB_ExprData data) {
+    if (xs->len == xs->cap)
+        cb_exprs_grow(xs);
+
+    xs->kinds[xs->len] = k;
+    xs->pos[xs->len] = pos;
+    xs->data[xs->len] = data;
+    if (xs->same)
+        cb_expr_share(xs, xs->len);
+    return xs->len++;
 }
 
-void cb_expr_free(CB_Expr* e) {
-    if (e->kind == CB_EXPR_LIT) {
-        cb_value_free(&e->lit);
-    } else if (e->kind == CB_EXPR_IDENT) {
-        as_free(&e->ident);
-    } else if (cb_expr_kind_is_unary(e->kind)) {
-        cb_expr_free(e->unary);
-        free(e->unary);
-    } else if (cb_expr_kind_is_binary(e->kind)) {
-        cb_expr_free(e->lhs);
-        cb_expr_free(e->rhs);
-        free(e->lhs);
-        free(e->rhs);
+CB_ExprId cb_expr_new_literal(CB_Exprs* xs, Pos pos, CB_Value v) {
+    av_append(&xs->lits, v);
+    return cb_expr_push(xs, CB_EXPR_LIT, pos,
+                        (CB_ExprData){.lit = xs->lits.len - 1});
+}
+
+CB_ExprId cb_expr_new_ident(CB_Exprs* xs, Pos pos, Atom ident) {
+    return cb_expr_push(xs, CB_EXPR_IDENT, pos, (CB_ExprData){.ident = ident});
+}
+
+CB_ExprId cb_expr_new_unary(CB_Exprs* xs, Pos pos, CB_ExprKind k,
+                            CB_ExprId operand) {
+    return cb_expr_push(xs, k, pos, (CB_ExprData){.unary = operand});
+}
+
+CB_ExprId cb_expr_new_binary(CB_Exprs* xs, Pos pos, CB_ExprKind k,
+                             CB_ExprId lhs, CB_ExprId rhs) {
+    return cb_expr_push(xs, k, pos, (CB_ExprData){.lhs = lhs, .rhs = rhs});
+}
+
+void cb_expr_shift(CB_Exprs* xs, CB_ExprId e, i32 shift) {
+    xs->pos[e].offset += shift;
+    if (cb_expr_kind_is_unary(xs->kinds[e])) {
+        cb_expr_shift(xs, xs->data[e].unary, shift);
+    } else if (cb_expr_kind_is_binary(xs->kinds[e])) {
+        cb_expr_shift(xs, xs->data[e].lhs, shift);
+        cb_expr_shift(xs, xs->data[e].rhs, shift);
     }
 }
 
-// takes ownership
-CB_OutputStmt cb_output_stmt_new(CB_Expr* exprs, usize exprs_count) {
+void cb_exprs_share(CB_Exprs* xs) {
+    if (xs->same)
+        return;
+
+    if (xs->cap == 0)
+        cb_exprs_grow(xs);
+
+    xs->same = malloc(xs->cap * sizeof(CB_ExprId));
+    check_alloc(xs->same);
+    xs->slots = ht_new(CB_EXPRS_INITIAL_SLOTS);
+
+    for (usize i = 0; i < xs->len; i++)
+        cb_expr_share(xs, i);
+}
+
+void cb_exprs_truncate(CB_Exprs* xs, usize len) {
+    if (len >= xs->len)
+        return;
+
+    // before the literals go, since they are hashed
+    if (xs->same) {
+        if (len == 0 && xs->len * 4 >= xs->slots.cap) {
+            ht_clear(&xs->slots);
+        } else {
+            for (usize i = len; i < xs->len; i++)
+                cb_expr_unshare(xs, i);
+        }
+    }
+
+    // literals are added in node order, so the first one to go belongs to
+    // the first literal node that goes
+    for (usize i = len; i < xs->len; i++) {
+        if (xs->kinds[i] == CB_EXPR_LIT) {
+            xs->lits.len = xs->data[i].lit;
+            break;
+        }
+    }
+
+    xs->len = len;
+}
+
+CB_ExprId cb_exprs_append(CB_Exprs* xs, const CB_Exprs* from) {
+    CB_ExprId base = xs->len;
+    u32 lits = xs->lits.len;
+    // the literals go first, since sharing looks at them
+    if (from->lits.len)
+        av_append_many(&xs->lits, from->lits.data, from->lits.len);
+
+    for (usize i = 0; i < from->len; i++) {
+        CB_ExprData d = from->data[i];
+        if (from->kinds[i] == CB_EXPR_LIT) {
+            d.lit += lits;
+        } else if (cb_expr_kind_is_unary(from->kinds[i])) {
+            d.unary += base;
+        } else if (cb_expr_kind_is_binary(from->kinds[i])) {
+            d.lhs += base;
+            d.rhs += base;
+        }
+
+        cb_expr_push(xs, from->kinds[i], from->pos[i], d);
+    }
+
+    return base;
+}
+
+void cb_exprs_free(CB_Exprs* xs) {
+    free(xs->kinds);
+    free(xs->pos);
+    free(xs->data);
+    av_free(&xs->lits);
+    free(xs->same);
+    ht_free(&xs->slots);
+    *xs = (CB_Exprs){0};
+}
+
+CB_OutputStmt cb_output_stmt_new(Arena* a, const CB_ExprId* exprs,
+                                 usize exprs_count) {
     return (CB_OutputStmt){
-        exprs,
+        ar_copy(a, exprs, exprs_count * sizeof(CB_ExprId)),
         exprs_count,
     };
 }
 
-void cb_output_stmt_free(CB_OutputStmt* s) {
-    for (usize i = 0; i < s->len; i++)
-        cb_expr_free(&s->exprs[i]);
-    free(s->exprs);
+CB_InputStmt cb_input_stmt_new(CB_ExprId target) {
+    return (CB_InputStmt){target};
+}
+
+CB_DeclareStmt cb_declare_stmt_new(Arena* a, const Atom* names, usize len,
+                                   CB_Type type, bool exported) {
+    return (CB_DeclareStmt){
+        .names = ar_copy(a, names, len * sizeof(Atom)),
+        .len = len,
+        .exported = exported,
+        .type = type,
+    };
 }
 
-CB_InputStmt cb_input_stmt_new(CB_Expr target) {
-    dupe(CB_Expr, duped_target, target);
-    return (CB_InputStmt){duped_target};
+CB_ConstantStmt cb_constant_stmt_new(Atom name, CB_ExprId value,
+                                     bool exported) {
+    return (CB_ConstantStmt){name, exported, value};
 }
 
-void cb_input_stmt_free(CB_InputStmt* s) {
-    cb_expr_free(s->target);
-    free(s->target);
+CB_AssignStmt cb_assign_stmt_new(CB_ExprId target, CB_ExprId value) {
+    return (CB_AssignStmt){target, value};
 }
 
-CB_Stmt cb_stmt_new_expr(Pos pos, CB_Expr expr) {
+CB_Stmt cb_stmt_new_expr(Pos pos, CB_ExprId expr) {
     return (CB_Stmt){CB_STMT_EXPR, pos, .expr = expr};
 }
 
@@ -187,27 +396,77 @@ CB_Stmt cb_stmt_new_input(Pos pos, CB_InputStmt input) {
     return (CB_Stmt){CB_STMT_INPUT, pos, .input = input};
 }
 
-void cb_stmt_free(CB_Stmt* s) {
+CB_Stmt cb_stmt_new_declare(Pos pos, CB_DeclareStmt declare) {
+    return (CB_Stmt){CB_STMT_DECLARE, pos, .declare = declare};
+}
+
+CB_Stmt cb_stmt_new_constant(Pos pos, CB_ConstantStmt constant) {
+    return (CB_Stmt){CB_STMT_CONSTANT, pos, .constant = constant};
+}
+
+CB_Stmt cb_stmt_new_assign(Pos pos, CB_AssignStmt assign) {
+    return (CB_Stmt){CB_STMT_ASSIGN, pos, .assign = assign};
+}
+
+CB_Stmt cb_stmt_new_marker(Pos pos, CB_StmtKind kind) {
+    return (CB_Stmt){kind, pos, {0}};
+}
+
+void cb_stmt_shift(CB_Exprs* xs, CB_Stmt* s, i32 shift) {
+    s->pos.offset += shift;
+    switch (s->kind) {
+        case CB_STMT_EXPR: {
+            cb_expr_shift(xs, s->expr, shift);
+        } break;
+        case CB_STMT_OUTPUT: {
+            for (usize i = 0; i < s->output.len; i++)
+                cb_expr_shift(xs, s->output.exprs[i], shift);
+        } break;
+        case CB_STMT_INPUT: {
+            cb_expr_shift(xs, s->input.target, shift);
+        } break;
+        case CB_STMT_CONSTANT: {
+            cb_expr_shift(xs, s->constant.value, shift);
+        } break;
+        case CB_STMT_ASSIGN: {
+            cb_expr_shift(xs, s->assign.target, shift);
+            cb_expr_shift(xs, s->assign.value, shift);
+        } break;
+        default: break;
+    }
+}
+
+void cb_stmt_rebase(CB_Stmt* s, CB_ExprId base) {
     switch (s->kind) {
         case CB_STMT_EXPR: {
-            cb_expr_free(&s->expr);
+            s->expr += base;
         } break;
         case CB_STMT_OUTPUT: {
-            cb_output_stmt_free(&s->output);
+            for (usize i = 0; i < s->output.len; i++)
+                s->output.exprs[i] += base;
         } break;
         case CB_STMT_INPUT: {
-            cb_input_stmt_free(&s->input);
+            s->input.target += base;
+        } break;
+        case CB_STMT_CONSTANT: {
+            s->constant.value += base;
+        } break;
+        case CB_STMT_ASSIGN: {
+            s->assign.target += base;
+            s->assign.value += base;
         } break;
+        default: break;
     }
 }
 
-CB_Program cb_program_new(CB_Stmt* stmts, usize len) {
-    return (CB_Program){stmts, len};
+CB_Program cb_program_new(CB_Stmt* stmts, CB_TokenRange* ranges, usize len,
+                          CB_Exprs exprs, Arena arena, const AtomTable* atoms) {
+    return (CB_Program){stmts, ranges, len, exprs, arena, atoms};
 }
 
 void cb_program_free(CB_Program* p) {
-    for (usize i = 0; i < p->len; i++) {
-        cb_stmt_free(&p->stmts[i]);
-    }
     free(p->stmts);
+    free(p->ranges);
+    cb_exprs_free(&p->exprs);
+    ar_free(&p->arena);
 }
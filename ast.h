@@ -14,7 +14,11 @@
 #include <stdbool.h>
 
 #include "a_string.h"
+#include "a_vector.h"
+#include "arena.h"
+#include "atom.h"
 #include "common.h"
+#include "hashtab.h"
 #include "lexer_types.h"
 
 typedef enum {
@@ -33,6 +37,10 @@ typedef enum {
 
 typedef u32 CB_Type;
 
+// every expression in an AST lives in the CB_Exprs pool of the program it
+// belongs to, and every list and string in its arena, so none of them are
+// freed on their own
+
 typedef union {
     struct {
         u32 begin;
@@ -71,8 +79,10 @@ CB_Value cb_value_new_integer(i64 integer);
 CB_Value cb_value_new_real(f64 real);
 CB_Value cb_value_new_boolean(bool boolean);
 CB_Value cb_value_new_char(char chr);
-CB_Value cb_value_new_string(a_string s);
-void cb_value_free(CB_Value* v);
+// copies s into a
+CB_Value cb_value_new_string(Arena* a, a_string s);
+// data must be null terminated, and live in the same arena as the value
+CB_Value cb_value_new_arena_string(char* data, usize len);
 
 typedef enum {
     CB_EXPR_LIT = 0,
@@ -111,74 +121,179 @@ typedef enum {
 #define cb_expr_kind_is_unary(k)                                               \
     (CB_EXPR_NEGATION <= (k) && (k) <= CB_EXPR_DEREF)
 #define cb_expr_kind_is_binary(k) (CB_EXPR_ADD <= (k) && (k) <= CB_EXPR_BITXOR)
+// reads variables at most, and never changes any
+#define cb_expr_kind_is_pure(k) ((k) != CB_EXPR_FNCALL)
 
 const char* expr_kind_string(CB_ExprKind k);
 
-typedef struct CB_Expr CB_Expr;
-typedef struct CB_Expr {
-    CB_ExprKind kind;
-    Pos pos;
-    union {
-        CB_Value lit;
-        a_string ident;
-        CB_Expr* unary;
-        struct {
-            CB_Expr* lhs;
-            CB_Expr* rhs;
-        };
+// an expression, as the index of its node in a CB_Exprs
+typedef u32 CB_ExprId;
+
+typedef union {
+    u32 lit; // index into the literal values
+    Atom ident;
+    CB_ExprId unary;
+    struct {
+        CB_ExprId lhs;
+        CB_ExprId rhs;
     };
-} CB_Expr;
+} CB_ExprData;
+
+AV_DECL(CB_Value, CB_Values)
+
+// expression nodes, stored as parallel arrays indexed by CB_ExprId. children
+// always come before their parents, and the nodes of one statement are all
+// next to each other.
+typedef struct {
+    u8* kinds; // CB_ExprKind
+    Pos* pos;
+    CB_ExprData* data;
+    usize len;
+    usize cap;
+    // literal values are kept to the side, so that the nodes stay small
+    CB_Values lits;
+
+    // only with sharing on, see cb_exprs_share. for each node, the first node
+    // with the same kind, literal value and (shared) operands, if the whole
+    // tree under it is pure. otherwise, the node itself.
+    CB_ExprId* same;
+    HashTable slots; // of the nodes that are the first of their kind
+} CB_Exprs;
+
+CB_ExprId cb_expr_new_literal(CB_Exprs* xs, Pos pos, CB_Value v);
+CB_ExprId cb_expr_new_ident(CB_Exprs* xs, Pos pos, Atom ident);
+CB_ExprId cb_expr_new_unary(CB_Exprs* xs, Pos pos, CB_ExprKind k,
+                            CB_ExprId operand);
+CB_ExprId cb_expr_new_binary(CB_Exprs* xs, Pos pos, CB_ExprKind k,
+                             CB_ExprId lhs, CB_ExprId rhs);
+// moves every position in the expression by shift bytes
+void cb_expr_shift(CB_Exprs* xs, CB_ExprId e, i32 shift);
 
-CB_Expr cb_expr_new_literal(Pos pos, CB_Value v);
-CB_Expr cb_expr_new_ident(Pos pos, a_string s);
-CB_Expr cb_expr_new_unary(Pos pos, CB_ExprKind k, CB_Expr operand);
-CB_Expr cb_expr_new_binary(Pos pos, CB_ExprKind k, CB_Expr lhs, CB_Expr rhs);
-void cb_expr_free(CB_Expr* e);
+// the value of a CB_EXPR_LIT node
+#define cb_expr_lit(xs, e) (&(xs)->lits.data[(xs)->data[(e)].lit])
+
+// turns on sharing for xs, from the nodes already in it onwards. equal pure
+// trees then get the same cb_expr_same id, so that what was worked out for
+// one of them can be reused for the others. every node is still kept, with
+// its own position.
+void cb_exprs_share(CB_Exprs* xs);
+// the id shared by every tree equal to e, or e itself if sharing is off
+#define cb_expr_same(xs, e) ((xs)->same ? (xs)->same[(e)] : (e))
+
+// throws away the nodes from len onwards, along with their literals
+void cb_exprs_truncate(CB_Exprs* xs, usize len);
+// adds every node of from to the end of xs. the ids of from's nodes go up by
+// the old length of xs, which is returned.
+CB_ExprId cb_exprs_append(CB_Exprs* xs, const CB_Exprs* from);
+void cb_exprs_free(CB_Exprs* xs);
 
 typedef enum {
     CB_STMT_EXPR = 0,
     CB_STMT_OUTPUT,
     CB_STMT_INPUT,
+    CB_STMT_DECLARE,
+    CB_STMT_CONSTANT,
+    CB_STMT_ASSIGN,
+    // a scope is kept flat, as the statement that opens it and the one that
+    // closes it, so that everything inside is still a top level statement
+    // that can be compiled as soon as it is parsed
+    CB_STMT_SCOPE,
+    CB_STMT_ENDSCOPE,
     // TODO: add the rest
 } CB_StmtKind;
 
 typedef struct {
-    CB_Expr* exprs;
+    CB_ExprId* exprs;
     usize len;
 } CB_OutputStmt;
 
-CB_OutputStmt cb_output_stmt_new(CB_Expr* exprs, usize exprs_count);
-void cb_output_stmt_free(CB_OutputStmt* s);
+// copies exprs into a
+CB_OutputStmt cb_output_stmt_new(Arena* a, const CB_ExprId* exprs,
+                                 usize exprs_count);
 
 typedef struct {
     // we will figure out if this is an Lvalue later
-    CB_Expr* target;
+    CB_ExprId target;
 } CB_InputStmt;
 
-CB_InputStmt cb_input_stmt_new(CB_Expr target);
-void cb_input_stmt_free(CB_InputStmt* s);
+CB_InputStmt cb_input_stmt_new(CB_ExprId target);
+
+typedef struct {
+    Atom* names;
+    u16 len;
+    bool exported;
+    CB_Type type; // only primitives for now
+} CB_DeclareStmt;
+
+// copies names into a
+CB_DeclareStmt cb_declare_stmt_new(Arena* a, const Atom* names, usize len,
+                                   CB_Type type, bool exported);
+
+typedef struct {
+    Atom name;
+    bool exported;
+    CB_ExprId value;
+} CB_ConstantStmt;
+
+CB_ConstantStmt cb_constant_stmt_new(Atom name, CB_ExprId value,
+                                     bool exported);
+
+typedef struct {
+    // like INPUT's, checked to be something that can be assigned to later
+    CB_ExprId target;
+    CB_ExprId value;
+} CB_AssignStmt;
+
+CB_AssignStmt cb_assign_stmt_new(CB_ExprId target, CB_ExprId value);
 
 typedef struct {
     CB_StmtKind kind;
     Pos pos;
     union {
-        CB_Expr expr;
+        CB_ExprId expr;
         CB_OutputStmt output;
         CB_InputStmt input;
+        CB_DeclareStmt declare;
+        CB_ConstantStmt constant;
+        CB_AssignStmt assign;
     };
 } CB_Stmt;
 
-CB_Stmt cb_stmt_new_expr(Pos pos, CB_Expr expr);
+CB_Stmt cb_stmt_new_expr(Pos pos, CB_ExprId expr);
 CB_Stmt cb_stmt_new_output(Pos pos, CB_OutputStmt output);
 CB_Stmt cb_stmt_new_input(Pos pos, CB_InputStmt input);
-void cb_stmt_free(CB_Stmt* s);
+CB_Stmt cb_stmt_new_declare(Pos pos, CB_DeclareStmt declare);
+CB_Stmt cb_stmt_new_constant(Pos pos, CB_ConstantStmt constant);
+CB_Stmt cb_stmt_new_assign(Pos pos, CB_AssignStmt assign);
+// SCOPE or ENDSCOPE, which have nothing else in them
+CB_Stmt cb_stmt_new_marker(Pos pos, CB_StmtKind kind);
+void cb_stmt_shift(CB_Exprs* xs, CB_Stmt* s, i32 shift);
+// adds base to every expression id in the statement, after its expressions
+// were moved with cb_exprs_append
+void cb_stmt_rebase(CB_Stmt* s, CB_ExprId base);
+
+// the tokens a top level statement was parsed from, so that it can be
+// reparsed on its own
+typedef struct {
+    u32 begin;
+    u32 end;
+} CB_TokenRange;
 
 typedef struct {
     CB_Stmt* stmts;
+    CB_TokenRange* ranges; // one for each statement
     usize len;
+    // where the statements' expressions live
+    CB_Exprs exprs;
+    // and everything else they point to
+    Arena arena;
+    // names of the identifiers in the program, not owned
+    const AtomTable* atoms;
 } CB_Program;
 
-CB_Program cb_program_new(CB_Stmt* stmts, usize len);
+// takes ownership of stmts, ranges, exprs and arena
+CB_Program cb_program_new(CB_Stmt* stmts, CB_TokenRange* ranges, usize len,
+                          CB_Exprs exprs, Arena arena, const AtomTable* atoms);
 void cb_program_free(CB_Program* p);
 
 #endif // _AST_H
@@ -0,0 +1,479 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a_string.h"
+#include "ast.h"
+#include "ast_cache.h"
+#include "atom.h"
+#include "common.h"
+
+// a cache file is a header followed by the program's arrays, laid out just
+// like they are in memory, so that loading one is mostly mapping it. the only
+// pointers in there, to the expressions of an OUTPUT, to the names of a
+// DECLARE and to the text of a string literal, are stored as offsets and fixed
+// up after mapping.
+
+// written as a native u64, so files from a machine with the other byte order
+// never match
+#define AC_MAGIC 0x7473616362630001ull
+
+// the arrays are only usable as they are if their elements have the same
+// layout as when they were written
+#define AC_LAYOUT                                                              \
+    ((u32)sizeof(CB_Stmt) | (u32)sizeof(CB_Value) << 8 |                       \
+     (u32)sizeof(CB_ExprData) << 16 | (u32)sizeof(Pos) << 24)
+
+typedef struct {
+    u64 offset; // from the start of the file, always 8 byte aligned
+    u64 count;  // of elements
+} AcSection;
+
+typedef struct {
+    u64 magic;
+    u32 version;
+    u32 layout;
+    u64 src_len;
+    u64 key;
+    u64 size;     // of the whole file
+    u64 checksum; // of everything after the header
+    AcSection stmts;
+    AcSection ranges;
+    AcSection kinds;
+    AcSection pos;
+    AcSection data;
+    AcSection same; // empty if sharing was off
+    AcSection lits;
+    AcSection ids; // the expressions of every OUTPUT and the names of every
+                   // DECLARE, one after another
+    AcSection strings; // the text of every string literal, null terminated
+    AcSection names;   // the atom table's entries
+    AcSection text;    // and the names they point into
+} AcHeader;
+
+// a multiply and shift hash, 8 bytes at a time. it only has to tell sources
+// and cache files apart, not hold up against anyone trying to collide it.
+static u64 ac_hash(const void* data, usize len) {
+    const u64 m = 0x9e3779b97f4a7c15ull;
+    const u8* p = data;
+    u64 h = len * m;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        u64 w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * m;
+        h ^= h >> 29;
+    }
+
+    u64 w = 0;
+    if (len)
+        memcpy(&w, p, len);
+    h = (h ^ w) * m;
+
+    // murmur3's finalizer, so that every input bit reaches every output bit
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+u64 ac_key(const char* src, usize len) {
+    return ac_hash(src, len);
+}
+
+static a_string ac_path(const char* dir, u64 key) {
+    return as_asprintf("%s/%016llx.ast", dir, (unsigned long long)key);
+}
+
+// reserves room for count elements of size bytes at the end of the file
+static AcSection ac_place(usize* size, usize count, usize elem) {
+    usize offset = (*size + 7) & ~(usize)7;
+    *size = offset + count * elem;
+    return (AcSection){offset, count};
+}
+
+// NULL if the section does not fit in the file
+static void* ac_section(const AstCache* c, AcSection s, usize elem) {
+    if (s.offset % 8 != 0 || s.offset < sizeof(AcHeader) ||
+        s.offset > c->size || s.count > (c->size - s.offset) / elem)
+        return NULL;
+
+    return (u8*)c->map + s.offset;
+}
+
+static bool ac_check_header(const AstCache* c, u64 key, usize len) {
+    const AcHeader* h = c->map;
+    if (h->magic != AC_MAGIC || h->version != AC_VERSION ||
+        h->layout != AC_LAYOUT)
+        return false;
+
+    if (h->src_len != len || h->key != key || h->size != c->size)
+        return false;
+
+    return h->checksum == ac_hash((u8*)c->map + sizeof(AcHeader),
+                                  c->size - sizeof(AcHeader));
+}
+
+// any other byte in a bool is not even safe to read as one
+static bool ac_bool_ok(const bool* b) {
+    u8 v;
+    memcpy(&v, b, 1);
+    return v <= 1;
+}
+
+// makes sure that nothing in the file points outside of it, fixing up the
+// pointers on the way, then fills in c->prog
+static bool ac_map_program(AstCache* c, AtomTable* atoms) {
+    const AcHeader* h = c->map;
+    CB_Stmt* stmts = ac_section(c, h->stmts, sizeof(CB_Stmt));
+    CB_TokenRange* ranges = ac_section(c, h->ranges, sizeof(CB_TokenRange));
+    u8* kinds = ac_section(c, h->kinds, sizeof(u8));
+    Pos* pos = ac_section(c, h->pos, sizeof(Pos));
+    CB_ExprData* data = ac_section(c, h->data, sizeof(CB_ExprData));
+    CB_ExprId* same = ac_section(c, h->same, sizeof(CB_ExprId));
+    CB_Value* lits = ac_section(c, h->lits, sizeof(CB_Value));
+    CB_ExprId* ids = ac_section(c, h->ids, sizeof(CB_ExprId));
+    char* strings = ac_section(c, h->strings, sizeof(char));
+    AtomEntry* names = ac_section(c, h->names, sizeof(AtomEntry));
+    char* text = ac_section(c, h->text, sizeof(char));
+    if (!stmts || !ranges || !kinds || !pos || !data || !same || !lits ||
+        !ids || !strings || !names || !text)
+        return false;
+
+    usize len = h->stmts.count, nexprs = h->kinds.count;
+    if (h->ranges.count != len || h->pos.count != nexprs ||
+        h->data.count != nexprs ||
+        (h->same.count != 0 && h->same.count != nexprs))
+        return false;
+
+    for (usize i = 0; i < h->same.count; i++)
+        if (same[i] > i)
+            return false;
+
+    for (usize i = 0; i < h->lits.count; i++) {
+        CB_Value* v = &lits[i];
+        if (v->kind > CB_PRIM_STRING)
+            return false;
+
+        if (v->kind == CB_PRIM_BOOLEAN && !ac_bool_ok(&v->boolean))
+            return false;
+
+        if (v->kind != CB_PRIM_STRING)
+            continue;
+
+        uintptr_t at = (uintptr_t)v->string.data;
+        if (at >= h->strings.count || v->string.len >= h->strings.count - at ||
+            strings[at + v->string.len] != '\0')
+            return false;
+        v->string.data = &strings[at];
+    }
+
+    // children always come before their parents
+    for (usize i = 0; i < nexprs; i++) {
+        CB_ExprData d = data[i];
+        if (kinds[i] == CB_EXPR_LIT) {
+            if (d.lit >= h->lits.count)
+                return false;
+        } else if (kinds[i] == CB_EXPR_IDENT) {
+            if (d.ident >= h->names.count)
+                return false;
+        } else if (cb_expr_kind_is_unary(kinds[i])) {
+            if (d.unary >= i)
+                return false;
+        } else if (cb_expr_kind_is_binary(kinds[i])) {
+            if (d.lhs >= i || d.rhs >= i)
+                return false;
+        } else {
+            return false;
+        }
+    }
+
+    for (usize i = 0; i < len; i++) {
+        CB_Stmt* s = &stmts[i];
+        switch (s->kind) {
+            case CB_STMT_EXPR: {
+                if (s->expr >= nexprs)
+                    return false;
+            } break;
+            case CB_STMT_OUTPUT: {
+                uintptr_t at = (uintptr_t)s->output.exprs;
+                if (at > h->ids.count || s->output.len > h->ids.count - at)
+                    return false;
+
+                s->output.exprs = &ids[at];
+                for (usize j = 0; j < s->output.len; j++)
+                    if (s->output.exprs[j] >= nexprs)
+                        return false;
+            } break;
+            case CB_STMT_INPUT: {
+                if (s->input.target >= nexprs)
+                    return false;
+            } break;
+            case CB_STMT_DECLARE: {
+                uintptr_t at = (uintptr_t)s->declare.names;
+                if (at > h->ids.count || s->declare.len > h->ids.count - at ||
+                    !ac_bool_ok(&s->declare.exported) ||
+                    s->declare.type == CB_PRIM_NULL ||
+                    s->declare.type > CB_PRIM_STRING)
+                    return false;
+
+                s->declare.names = &ids[at];
+                for (usize j = 0; j < s->declare.len; j++)
+                    if (s->declare.names[j] >= h->names.count)
+                        return false;
+            } break;
+            case CB_STMT_CONSTANT: {
+                if (s->constant.name >= h->names.count ||
+                    !ac_bool_ok(&s->constant.exported) ||
+                    s->constant.value >= nexprs)
+                    return false;
+            } break;
+            case CB_STMT_ASSIGN: {
+                if (s->assign.target >= nexprs || s->assign.value >= nexprs)
+                    return false;
+            } break;
+            case CB_STMT_SCOPE:
+            case CB_STMT_ENDSCOPE: break;
+            default: return false;
+        }
+    }
+
+    for (usize i = 0; i < h->names.count; i++) {
+        AtomEntry e = names[i];
+        if (e.offset >= h->text.count || e.len >= h->text.count - e.offset ||
+            text[e.offset + e.len] != '\0')
+            return false;
+    }
+
+    // the atoms were handed out in order, so interning the names in the same
+    // order into an empty table hands out the same ones again
+    for (usize i = 0; i < h->names.count; i++) {
+        if (at_intern(atoms, &text[names[i].offset], names[i].len) != i) {
+            // two names were the same
+            at_free(atoms);
+            *atoms = at_new();
+            return false;
+        }
+    }
+
+    c->prog = (CB_Program){
+        .stmts = stmts,
+        .ranges = ranges,
+        .len = len,
+        .exprs = {.kinds = kinds,
+                  .pos = pos,
+                  .data = data,
+                  .same = h->same.count ? same : NULL,
+                  .len = nexprs,
+                  .cap = nexprs,
+                  .lits = {lits, h->lits.count, h->lits.count}},
+        .atoms = atoms,
+    };
+    return true;
+}
+
+bool ac_load(const char* dir, u64 key, usize len, AtomTable* atoms,
+             AstCache* out) {
+    if (atoms->entries.len != 0)
+        return false;
+
+    a_string path = ac_path(dir, key);
+    int fd = open(path.data, O_RDONLY);
+    as_free(&path);
+    if (fd < 0)
+        return false;
+
+    // private and writable, so that the pointers can be fixed up in place
+    // without the file ever changing
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (usize)st.st_size >= sizeof(AcHeader))
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    AstCache c = {.map = map, .size = st.st_size};
+    if (!ac_check_header(&c, key, len) || !ac_map_program(&c, atoms)) {
+        ac_close(&c);
+        return false;
+    }
+
+    *out = c;
+    return true;
+}
+
+static bool ac_write_all(int fd, const u8* buf, usize len) {
+    while (len > 0) {
+        isize n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        buf += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+// lays the whole file out in memory, ready to be written
+static u8* ac_serialize(u64 key, usize len, const CB_Program* prog,
+                        usize* size) {
+    const CB_Exprs* xs = &prog->exprs;
+    const AtomTable* atoms = prog->atoms;
+
+    usize nids = 0, nstrings = 0;
+    for (usize i = 0; i < prog->len; i++) {
+        if (prog->stmts[i].kind == CB_STMT_OUTPUT)
+            nids += prog->stmts[i].output.len;
+        else if (prog->stmts[i].kind == CB_STMT_DECLARE)
+            nids += prog->stmts[i].declare.len;
+    }
+    for (usize i = 0; i < xs->lits.len; i++)
+        if (xs->lits.data[i].kind == CB_PRIM_STRING)
+            nstrings += xs->lits.data[i].string.len + 1;
+
+    AcHeader h = {
+        .magic = AC_MAGIC,
+        .version = AC_VERSION,
+        .layout = AC_LAYOUT,
+        .src_len = len,
+        .key = key,
+    };
+    usize sz = sizeof(AcHeader);
+    h.stmts = ac_place(&sz, prog->len, sizeof(CB_Stmt));
+    h.ranges = ac_place(&sz, prog->len, sizeof(CB_TokenRange));
+    h.kinds = ac_place(&sz, xs->len, sizeof(u8));
+    h.pos = ac_place(&sz, xs->len, sizeof(Pos));
+    h.data = ac_place(&sz, xs->len, sizeof(CB_ExprData));
+    h.same = ac_place(&sz, xs->same ? xs->len : 0, sizeof(CB_ExprId));
+    h.lits = ac_place(&sz, xs->lits.len, sizeof(CB_Value));
+    h.ids = ac_place(&sz, nids, sizeof(CB_ExprId));
+    h.strings = ac_place(&sz, nstrings, sizeof(char));
+    h.names = ac_place(&sz, atoms->entries.len, sizeof(AtomEntry));
+    h.text = ac_place(&sz, atoms->text.len, sizeof(char));
+    h.size = sz;
+
+    u8* buf = calloc(sz, 1);
+    check_alloc(buf);
+
+    CB_Stmt* stmts = (CB_Stmt*)&buf[h.stmts.offset];
+    CB_ExprId* ids = (CB_ExprId*)&buf[h.ids.offset];
+    usize at = 0;
+    for (usize i = 0; i < prog->len; i++) {
+        stmts[i] = prog->stmts[i];
+        if (stmts[i].kind == CB_STMT_OUTPUT) {
+            CB_OutputStmt* o = &stmts[i].output;
+            if (o->len)
+                memcpy(&ids[at], o->exprs, o->len * sizeof(CB_ExprId));
+            o->exprs = (CB_ExprId*)(uintptr_t)at;
+            at += o->len;
+        } else if (stmts[i].kind == CB_STMT_DECLARE) {
+            // atoms are u32s too
+            CB_DeclareStmt* d = &stmts[i].declare;
+            if (d->len)
+                memcpy(&ids[at], d->names, d->len * sizeof(Atom));
+            d->names = (Atom*)(uintptr_t)at;
+            at += d->len;
+        }
+    }
+
+    CB_Value* lits = (CB_Value*)&buf[h.lits.offset];
+    char* strings = (char*)&buf[h.strings.offset];
+    at = 0;
+    for (usize i = 0; i < xs->lits.len; i++) {
+        lits[i] = xs->lits.data[i];
+        if (lits[i].kind != CB_PRIM_STRING)
+            continue;
+
+        // the terminator is already there, from calloc
+        memcpy(&strings[at], lits[i].string.data, lits[i].string.len);
+        lits[i].string.data = (char*)(uintptr_t)at;
+        at += lits[i].string.len + 1;
+    }
+
+#define AC_COPY(sec, src, elem)                                                \
+    if (h.sec.count)                                                           \
+        memcpy(&buf[h.sec.offset], (src), h.sec.count * (elem));
+    AC_COPY(ranges, prog->ranges, sizeof(CB_TokenRange))
+    AC_COPY(kinds, xs->kinds, sizeof(u8))
+    AC_COPY(pos, xs->pos, sizeof(Pos))
+    AC_COPY(data, xs->data, sizeof(CB_ExprData))
+    AC_COPY(same, xs->same, sizeof(CB_ExprId))
+    AC_COPY(names, atoms->entries.data, sizeof(AtomEntry))
+    AC_COPY(text, atoms->text.data, sizeof(char))
+#undef AC_COPY
+
+    h.checksum = ac_hash(&buf[sizeof(AcHeader)], sz - sizeof(AcHeader));
+    memcpy(buf, &h, sizeof(AcHeader));
+    *size = sz;
+    return buf;
+}
+
+bool ac_store(const char* dir, u64 key, usize len, const CB_Program* prog) {
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST)
+        return false;
+
+    usize size;
+    u8* buf = ac_serialize(key, len, prog, &size);
+
+    // written next to where it goes and then renamed over it, so that a
+    // build running at the same time never sees half a file
+    a_string path = ac_path(dir, key);
+    a_string tmp = as_asprintf("%s.XXXXXX", path.data);
+    bool res = false;
+    int fd = mkstemp(tmp.data);
+    if (fd >= 0) {
+        // mkstemp makes it private, but other users sharing the cache have to
+        // be able to load it too
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+
+        bool ok = ac_write_all(fd, buf, size);
+        ok = close(fd) == 0 && ok;
+        res = ok && rename(tmp.data, path.data) == 0;
+        if (!res) {
+            int saved = errno;
+            unlink(tmp.data);
+            errno = saved;
+        }
+    }
+
+    int saved = errno;
+    free(buf);
+    as_free(&tmp);
+    as_free(&path);
+    errno = saved;
+    return res;
+}
+
+void ac_close(AstCache* c) {
+    if (c->map)
+        munmap(c->map, c->size);
+
+    *c = (AstCache){0};
+}
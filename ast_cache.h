@@ -0,0 +1,46 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _AST_CACHE_H
+#define _AST_CACHE_H
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "atom.h"
+#include "common.h"
+
+// bump whenever the layout of a cache file changes, or the parser makes
+// something different out of the same source
+#define AC_VERSION 3
+
+// a program mapped straight from a cache file. its arrays point into the
+// mapping, so it is freed with ac_close, never with cb_program_free.
+typedef struct {
+    CB_Program prog;
+    void* map;
+    usize size;
+} AstCache;
+
+// the key a source is cached under
+u64 ac_key(const char* src, usize len);
+
+// looks for the program parsed from a source with this key and length in dir.
+// the names of its identifiers are interned into atoms, which must be empty.
+// returns false if there is no usable cache file, including one that is from
+// another version of cbc or is corrupted.
+bool ac_load(const char* dir, u64 key, usize len, AtomTable* atoms,
+             AstCache* out);
+// saves a program parsed from a source with this key and length into dir,
+// making dir if it does not exist. returns false and leaves errno set if it
+// could not be written.
+bool ac_store(const char* dir, u64 key, usize len, const CB_Program* prog);
+void ac_close(AstCache* c);
+
+#endif // _AST_CACHE_H
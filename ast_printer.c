@@ -111,20 +111,21 @@ void ap_visit_value(AstPrinter* p, const CB_Value* val) {
     }
 }
 
-void ap_visit_expr(AstPrinter* p, CB_Expr* e) {
-    const char* kind = expr_kind_string(e->kind);
-    p->writef(p, "%s(", kind);
-    if (cb_expr_kind_is_binary(e->kind)) {
-        ap_visit_expr(p, e->lhs);
+void ap_visit_expr(AstPrinter* p, CB_ExprId e) {
+    const CB_Exprs* xs = p->exprs;
+    CB_ExprKind k = xs->kinds[e];
+    p->writef(p, "%s(", expr_kind_string(k));
+    if (cb_expr_kind_is_binary(k)) {
+        ap_visit_expr(p, xs->data[e].lhs);
         p->write(p, ", ");
-        ap_visit_expr(p, e->rhs);
+        ap_visit_expr(p, xs->data[e].rhs);
     } else {
-        if (cb_expr_kind_is_unary(e->kind)) {
-            ap_visit_expr(p, e->unary);
-        } else if (e->kind == CB_EXPR_LIT) {
-            ap_visit_value(p, &e->lit);
+        if (cb_expr_kind_is_unary(k)) {
+            ap_visit_expr(p, xs->data[e].unary);
+        } else if (k == CB_EXPR_LIT) {
+            ap_visit_value(p, cb_expr_lit(xs, e));
         } else {
-            p->writef(p, "%.*s", as_fmt(e->ident));
+            p->writef(p, "%s", at_str(p->atoms, xs->data[e].ident));
         }
     }
     p->write(p, ")");
@@ -133,7 +134,7 @@ void ap_visit_expr(AstPrinter* p, CB_Expr* e) {
 void ap_visit_output_stmt(AstPrinter* p, CB_OutputStmt* s) {
     p->write(p, "output{");
     for (usize i = 0; i < s->len; i++) {
-        ap_visit_expr(p, &s->exprs[i]);
+        ap_visit_expr(p, s->exprs[i]);
         if (i != s->len - 1)
             p->write(p, ", ");
     }
@@ -146,11 +147,43 @@ void ap_visit_input_stmt(AstPrinter* p, CB_InputStmt* s) {
     p->write(p, "}");
 }
 
+static const char* TYPE_NAMES[] = {
+    [CB_PRIM_NULL] = "NULL", [CB_PRIM_INTEGER] = "INTEGER",
+    [CB_PRIM_REAL] = "REAL", [CB_PRIM_BOOLEAN] = "BOOLEAN",
+    [CB_PRIM_CHAR] = "CHAR", [CB_PRIM_STRING] = "STRING",
+};
+
+void ap_visit_declare_stmt(AstPrinter* p, CB_DeclareStmt* s) {
+    p->write(p, s->exported ? "export declare{" : "declare{");
+    for (usize i = 0; i < s->len; i++) {
+        p->write(p, at_str(p->atoms, s->names[i]));
+        if (i + 1 != s->len)
+            p->write(p, ", ");
+    }
+    p->writef(p, ": %s}", TYPE_NAMES[s->type]);
+}
+
+void ap_visit_constant_stmt(AstPrinter* p, CB_ConstantStmt* s) {
+    p->write(p, s->exported ? "export constant{" : "constant{");
+    p->write(p, at_str(p->atoms, s->name));
+    p->write(p, ", ");
+    ap_visit_expr(p, s->value);
+    p->write(p, "}");
+}
+
+void ap_visit_assign_stmt(AstPrinter* p, CB_AssignStmt* s) {
+    p->write(p, "assign{");
+    ap_visit_expr(p, s->target);
+    p->write(p, ", ");
+    ap_visit_expr(p, s->value);
+    p->write(p, "}");
+}
+
 void ap_visit_stmt(AstPrinter* p, CB_Stmt* s) {
     switch (s->kind) {
         case CB_STMT_EXPR: {
             p->write(p, "expr(");
-            ap_visit_expr(p, &s->expr);
+            ap_visit_expr(p, s->expr);
             p->write(p, ")");
         } break;
         case CB_STMT_INPUT: {
@@ -159,10 +192,27 @@ void ap_visit_stmt(AstPrinter* p, CB_Stmt* s) {
         case CB_STMT_OUTPUT: {
             ap_visit_output_stmt(p, &s->output);
         } break;
+        case CB_STMT_DECLARE: {
+            ap_visit_declare_stmt(p, &s->declare);
+        } break;
+        case CB_STMT_CONSTANT: {
+            ap_visit_constant_stmt(p, &s->constant);
+        } break;
+        case CB_STMT_ASSIGN: {
+            ap_visit_assign_stmt(p, &s->assign);
+        } break;
+        case CB_STMT_SCOPE: {
+            p->write(p, "scope{}");
+        } break;
+        case CB_STMT_ENDSCOPE: {
+            p->write(p, "endscope{}");
+        } break;
     }
 }
 
 void ap_visit_program(AstPrinter* p, CB_Program* prog) {
+    p->exprs = &prog->exprs;
+    p->atoms = prog->atoms;
     p->write(p, "program{\n");
     for (usize i = 0; i < prog->len; i++) {
         ap_visit_stmt(p, &prog->stmts[i]);
@@ -25,6 +25,9 @@ typedef struct AstPrinter {
     FILE* fp;     // null if file writer is not used
     a_string buf; // for the string writer
     u32 indent;
+    // set by ap_visit_program, needed to print expressions and identifiers
+    const CB_Exprs* exprs;
+    const AtomTable* atoms;
 } AstPrinter;
 
 void ap_write_stdout(AstPrinter* p, const char* data);
@@ -39,10 +42,13 @@ AstPrinter ap_new_with_file_writer(FILE* fp);
 AstPrinter ap_new_with_string_writer(void);
 
 void ap_visit_value(AstPrinter* p, const CB_Value* val);
-void ap_visit_expr(AstPrinter* p, CB_Expr* e);
+void ap_visit_expr(AstPrinter* p, CB_ExprId e);
 
 void ap_visit_output_stmt(AstPrinter* p, CB_OutputStmt* s);
 void ap_visit_input_stmt(AstPrinter* p, CB_InputStmt* s);
+void ap_visit_declare_stmt(AstPrinter* p, CB_DeclareStmt* s);
+void ap_visit_constant_stmt(AstPrinter* p, CB_ConstantStmt* s);
+void ap_visit_assign_stmt(AstPrinter* p, CB_AssignStmt* s);
 void ap_visit_stmt(AstPrinter* p, CB_Stmt* s);
 
 void ap_visit_program(AstPrinter* p, CB_Program* prog);
@@ -0,0 +1,85 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "a_string.h"
+#include "a_vector.h"
+#include "atom.h"
+#include "common.h"
+#include "hashtab.h"
+
+#define AT_INITIAL_SLOTS 256
+#define AT_INITIAL_TEXT  1024
+
+AtomTable at_new(void) {
+    return (AtomTable){
+        .slots = ht_new(AT_INITIAL_SLOTS),
+        .text = as_with_capacity(AT_INITIAL_TEXT),
+    };
+}
+
+void at_free(AtomTable* t) {
+    av_free(&t->entries);
+    ht_free(&t->slots);
+    as_free(&t->text);
+    *t = (AtomTable){0};
+}
+
+// FNV-1a
+static u32 at_hash(const char* s, usize len) {
+    u32 h = 2166136261u;
+    for (usize i = 0; i < len; i++) {
+        h ^= (u8)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+Atom at_intern(AtomTable* t, const char* s, u32 len) {
+    u32 hash = at_hash(s, len);
+    u32 i = ht_start(&t->slots, hash);
+
+    // only names with the same hash are ever compared
+    for (; !ht_empty(&t->slots, i); i = ht_next(&t->slots, i)) {
+        if (ht_hash(&t->slots, i) != hash)
+            continue;
+
+        Atom a = ht_id(&t->slots, i);
+        const AtomEntry* e = &t->entries.data[a];
+        if (e->len == len && !memcmp(&t->text.data[e->offset], s, len))
+            return a;
+    }
+
+    if (t->text.len + len + 1 > t->text.cap) {
+        usize cap = t->text.cap * 2;
+        while (t->text.len + len + 1 > cap)
+            cap *= 2;
+        as_reserve(&t->text, cap);
+    }
+
+    AtomEntry e = {.offset = t->text.len, .len = len};
+    memcpy(&t->text.data[t->text.len], s, len);
+    t->text.len += len;
+    t->text.data[t->text.len++] = '\0';
+
+    Atom res = t->entries.len;
+    av_append(&t->entries, e);
+    ht_insert(&t->slots, i, hash, res);
+    return res;
+}
+
+const char* at_str(const AtomTable* t, Atom a) {
+    return &t->text.data[t->entries.data[a].offset];
+}
+
+u32 at_len(const AtomTable* t, Atom a) {
+    return t->entries.data[a].len;
+}
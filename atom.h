@@ -0,0 +1,48 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _ATOM_H
+#define _ATOM_H
+
+#include <stdbool.h>
+
+#include "a_string.h"
+#include "a_vector.h"
+#include "common.h"
+#include "hashtab.h"
+
+// an interned name. equal names always get the same atom, so names can be
+// compared as integers. atoms are dense, starting from 0, in the order the
+// names were first seen.
+typedef u32 Atom;
+
+typedef struct {
+    u32 offset; // into the text buffer
+    u32 len;
+} AtomEntry;
+
+AV_DECL(AtomEntry, AtomEntries)
+
+// not thread-safe: a table may only be used by one thread at a time.
+typedef struct {
+    AtomEntries entries; // indexed by atom
+    HashTable slots;     // of the atoms, by the hash of their names
+    a_string text;       // every name, each followed by a null terminator
+} AtomTable;
+
+AtomTable at_new(void);
+void at_free(AtomTable* t);
+
+Atom at_intern(AtomTable* t, const char* s, u32 len);
+
+// null terminated, valid until the next name is interned.
+const char* at_str(const AtomTable* t, Atom a);
+u32 at_len(const AtomTable* t, Atom a);
+
+#endif // _ATOM_H
@@ -0,0 +1,303 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h> // used in macro
+#include <string.h>
+
+#include "../ast.h"
+#include "../atom.h"
+#include "../common.h"
+#include "../symbols.h"
+#include "compiler.h"
+#include "compiler_internal.h"
+
+// like the folded values, the types are kept next to the nodes rather than
+// in them. an expression whose type is CB_PRIM_NULL had an error, which was
+// reported where it was found, or uses a name that was declared with one.
+// nothing above it is checked, so that one mistake is only reported once.
+//
+// everything that gets through here can be compiled, so operations that are
+// valid but that cm_unary and cm_binary cannot do yet are reported too. a
+// folded expression is as good as a literal, whatever it was made of.
+
+
+#define is_numeric(k) ((k) == CB_PRIM_INTEGER || (k) == CB_PRIM_REAL)
+
+static void cm_grow_types(Compiler* c, CB_ExprId e) {
+    usize cap = c->types_cap ? c->types_cap : 256;
+    while (cap <= e)
+        cap *= 2;
+
+    c->types = realloc(c->types, cap * sizeof(CmTypeInfo));
+    check_alloc(c->types);
+    memset(&c->types[c->types_cap], 0,
+           (cap - c->types_cap) * sizeof(CmTypeInfo));
+    c->types_cap = cap;
+}
+
+static CB_Type check_unary(Compiler* c, CB_ExprKind k, CB_Type inner,
+                           Pos pos) {
+    switch (k) {
+        case CB_EXPR_GROUPING: return inner;
+        case CB_EXPR_NEGATION: {
+            if (is_numeric(inner))
+                return inner;
+            cm_diag(c, pos, "cannot negate a value of type %s",
+                    type_string(inner));
+        } break;
+        case CB_EXPR_NOT: {
+            if (inner == CB_PRIM_BOOLEAN)
+                return inner;
+            cm_diag(c, pos, "cannot do boolean NOT on a value of type %s",
+                    type_string(inner));
+        } break;
+        case CB_EXPR_BITNOT: {
+            if (inner == CB_PRIM_INTEGER)
+                return inner;
+            cm_diag(c, pos, "cannot do bitwise NOT on a value of type %s",
+                    type_string(inner));
+        } break;
+        default: {
+            cm_diag(c, pos, "%s is not implemented yet", expr_kind_string(k));
+        } break;
+    }
+
+    return CB_PRIM_NULL;
+}
+
+// what cm_binary can do, on operands of types that were already checked
+static bool binary_implemented(CB_ExprKind k, CB_Type lhs, CB_Type rhs) {
+    switch (k) {
+        case CB_EXPR_ADD:
+        case CB_EXPR_SUB:
+        case CB_EXPR_MUL:
+        case CB_EXPR_DIV: return is_numeric(lhs) && is_numeric(rhs);
+        default: return false;
+    }
+}
+
+// the type of the result if the operands fit, whether or not cm_binary can
+// do it yet
+static CB_Type check_binary_types(Compiler* c, CB_ExprKind k, CB_Type lhs,
+                                  CB_Type rhs, Pos pos, u8* conv) {
+    switch (k) {
+        case CB_EXPR_ADD: {
+            if (lhs == CB_PRIM_STRING && rhs == CB_PRIM_STRING)
+                return CB_PRIM_STRING;
+        } // fallthrough
+        case CB_EXPR_SUB:
+        case CB_EXPR_MUL:
+        case CB_EXPR_DIV:
+        case CB_EXPR_POW:
+        case CB_EXPR_LT:
+        case CB_EXPR_GT:
+        case CB_EXPR_LEQ:
+        case CB_EXPR_GEQ: {
+            if (!is_numeric(lhs) || !is_numeric(rhs))
+                goto type_error;
+
+            // integers meeting reals are made real, and division is always
+            // done on reals
+            bool real = lhs == CB_PRIM_REAL || rhs == CB_PRIM_REAL;
+            if (real || k == CB_EXPR_DIV) {
+                if (lhs == CB_PRIM_INTEGER)
+                    *conv |= CM_CONV_LHS_REAL;
+                if (rhs == CB_PRIM_INTEGER)
+                    *conv |= CM_CONV_RHS_REAL;
+            }
+
+            if (CB_EXPR_LT <= k && k <= CB_EXPR_GEQ)
+                return CB_PRIM_BOOLEAN;
+            if (real || k == CB_EXPR_DIV)
+                return CB_PRIM_REAL;
+            return CB_PRIM_INTEGER;
+        } break;
+        case CB_EXPR_EQ:
+        case CB_EXPR_NEQ: {
+            if (is_numeric(lhs) && is_numeric(rhs)) {
+                if (lhs != rhs)
+                    *conv |= lhs == CB_PRIM_INTEGER ? CM_CONV_LHS_REAL
+                                                    : CM_CONV_RHS_REAL;
+                return CB_PRIM_BOOLEAN;
+            }
+            if (lhs != rhs)
+                goto type_error;
+            return CB_PRIM_BOOLEAN;
+        } break;
+        case CB_EXPR_SHL:
+        case CB_EXPR_SHR:
+        case CB_EXPR_BITOR:
+        case CB_EXPR_BITAND:
+        case CB_EXPR_BITXOR: {
+            if (lhs != CB_PRIM_INTEGER || rhs != CB_PRIM_INTEGER)
+                goto type_error;
+            return CB_PRIM_INTEGER;
+        } break;
+        case CB_EXPR_AND:
+        case CB_EXPR_OR: {
+            if (lhs != CB_PRIM_BOOLEAN || rhs != CB_PRIM_BOOLEAN)
+                goto type_error;
+            return CB_PRIM_BOOLEAN;
+        } break;
+        default: {
+            cm_diag(c, pos, "%s is not implemented yet", expr_kind_string(k));
+            return CB_PRIM_NULL;
+        } break;
+    }
+
+    return CB_PRIM_NULL;
+type_error:
+    cm_diag(c, pos, "cannot perform binary operation %s with types %s and %s!",
+            expr_kind_string(k), type_string(lhs), type_string(rhs));
+    return CB_PRIM_NULL;
+}
+
+// the type of the result, with the operands that have to be made real first
+// added to *conv
+static CB_Type check_binary(Compiler* c, CB_ExprKind k, CB_Type lhs,
+                            CB_Type rhs, Pos pos, u8* conv) {
+    if (lhs > CB_PRIM_CUSTOM || rhs > CB_PRIM_CUSTOM) {
+        cm_diag(c, pos, "custom types not implemented for binary exprs!");
+        return CB_PRIM_NULL;
+    }
+
+    CB_Type res = check_binary_types(c, k, lhs, rhs, pos, conv);
+    if (res != CB_PRIM_NULL && !binary_implemented(k, lhs, rhs)) {
+        cm_diag(c, pos,
+                "binary operation %s with types %s and %s is not implemented "
+                "yet",
+                expr_kind_string(k), type_string(lhs), type_string(rhs));
+        return CB_PRIM_NULL;
+    }
+
+    return res;
+}
+
+static CB_Type cm_check_expr(Compiler* c, CB_ExprId e) {
+    if (e >= c->types_cap)
+        cm_grow_types(c, e);
+    if (c->types[e].gen == c->type_gen)
+        return c->types[e].type;
+
+    const CB_Exprs* xs = c->exprs;
+    CB_ExprKind k = xs->kinds[e];
+    CB_Type res = CB_PRIM_NULL;
+    u8 conv = 0;
+
+    const CB_Value* folded = cm_folded(c, e);
+    if (folded) {
+        res = folded->kind;
+    } else if (k == CB_EXPR_LIT) {
+        res = cb_expr_lit(xs, e)->kind;
+        if (res == CB_PRIM_NULL)
+            cm_diag(c, xs->pos[e], "NULL is not implemented yet");
+    } else if (k == CB_EXPR_IDENT) {
+        Atom name = xs->data[e].ident;
+        u32 i = sy_lookup(&c->syms, name);
+        if (i == SY_NONE)
+            cm_diag(c, xs->pos[e], "%s was not declared",
+                    at_str(c->atoms, name));
+        else if (sy_get(&c->syms, i)->type > CB_PRIM_CUSTOM)
+            cm_diag(c, xs->pos[e], "custom types not implemented!");
+        else
+            res = sy_get(&c->syms, i)->type;
+    } else if (cb_expr_kind_is_unary(k)) {
+        CB_ExprId operand = xs->data[e].unary;
+        CB_Type inner = cm_check_expr(c, operand);
+        if (inner != CB_PRIM_NULL)
+            res = check_unary(c, k, inner, xs->pos[operand]);
+    } else if (cb_expr_kind_is_binary(k)) {
+        // both sides are checked, so that the errors in each are reported
+        CB_Type lhs = cm_check_expr(c, xs->data[e].lhs);
+        CB_Type rhs = cm_check_expr(c, xs->data[e].rhs);
+        if (lhs != CB_PRIM_NULL && rhs != CB_PRIM_NULL)
+            res = check_binary(c, k, lhs, rhs, xs->pos[e], &conv);
+    }
+
+    c->types[e] = (CmTypeInfo){.type = res, .conv = conv, .gen = c->type_gen};
+    return res;
+}
+
+static void check_assign(Compiler* c, CB_AssignStmt* a) {
+    const CB_Exprs* xs = c->exprs;
+    CB_Type value = cm_check_expr(c, a->value);
+
+    // TODO: array elements
+    if (xs->kinds[a->target] != CB_EXPR_IDENT) {
+        cm_diag(c, xs->pos[a->target], "only a variable can be assigned to");
+        return;
+    }
+
+    Atom name = xs->data[a->target].ident;
+    CB_Type target = cm_check_expr(c, a->target);
+    if (target == CB_PRIM_NULL || value == CB_PRIM_NULL)
+        return;
+
+    const Symbol* s = sy_get(&c->syms, sy_lookup(&c->syms, name));
+    if (s->kind == SY_CONSTANT) {
+        cm_diag(c, xs->pos[a->target],
+                "%s is a constant, and cannot be assigned to",
+                at_str(c->atoms, name));
+        return;
+    }
+
+    // an integer is made real on the way in, like in a binary
+    if (target != value &&
+        !(target == CB_PRIM_REAL && value == CB_PRIM_INTEGER))
+        cm_diag(c, xs->pos[a->value],
+                "cannot assign a value of type %s to %s, which is of type %s",
+                type_string(value), at_str(c->atoms, name),
+                type_string(target));
+}
+
+bool cm_check_stmt(Compiler* c, CB_Stmt* s) {
+    c->type_gen++;
+    u32 errors = c->error_count;
+    // a name without a type was declared by a statement with errors. using
+    // it is not reported again, but nothing that does is compiled either.
+    bool typed = true;
+
+    switch (s->kind) {
+        case CB_STMT_EXPR: {
+            typed = cm_check_expr(c, s->expr) != CB_PRIM_NULL;
+            if (typed)
+                cm_diag(c, s->pos,
+                        "expression statements are not implemented yet");
+        } break;
+        case CB_STMT_OUTPUT: {
+            for (usize i = 0; i < s->output.len; i++)
+                if (cm_check_expr(c, s->output.exprs[i]) == CB_PRIM_NULL)
+                    typed = false;
+        } break;
+        case CB_STMT_INPUT: {
+            typed = cm_check_expr(c, s->input.target) != CB_PRIM_NULL;
+            if (typed)
+                cm_diag(c, s->pos, "INPUT is not implemented yet");
+        } break;
+        case CB_STMT_CONSTANT: {
+            typed = cm_check_expr(c, s->constant.value) != CB_PRIM_NULL;
+        } break;
+        case CB_STMT_ASSIGN: {
+            check_assign(c, &s->assign);
+            typed = cm_type_of(c, s->assign.target).type != CB_PRIM_NULL &&
+                    cm_type_of(c, s->assign.value).type != CB_PRIM_NULL;
+        } break;
+        default: break;
+    }
+
+    return c->error_count == errors && typed;
+}
+
+CmTypeInfo cm_type_of(const Compiler* c, CB_ExprId e) {
+    if (!c->type_gen || e >= c->types_cap || c->types[e].gen != c->type_gen)
+        return (CmTypeInfo){0};
+    return c->types[e];
+}
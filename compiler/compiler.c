@@ -9,35 +9,77 @@
  */
 #define _POSIX_C_SOURCE 200809L
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h> // used in macro
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../a_string.h"
 #include "../a_vector.h"
+#include "../arena.h"
 #include "../ast.h"
 #include "../common.h"
 #include "compiler.h"
 #include "compiler_internal.h"
 
+// enough that big outputs take few writes
+#define CM_WRITER_BUFSZ (64 * 1024)
+
 Compiler cm_new(void) {
+    // stdout cannot be taken back, so it is written as it goes, and a
+    // program that fails to compile can leave part of its output there
     Compiler res = {
         .writer_state.mode = CM_WRITER_MODE_STDOUT,
+        .writer_state.fd = STDOUT_FILENO,
+        .writer_state.buf = as_with_capacity(CM_WRITER_BUFSZ),
     };
     return res;
 }
 
 bool cm_new_with_file_writer(const char* filename, Compiler* out) {
-    FILE* ptr = fopen(filename, "w");
-    if (!ptr) {
-        perror("fopen");
+    Compiler res = {0};
+    res.writer_state.mode = CM_WRITER_MODE_FILE;
+    res.writer_state.buf = as_with_capacity(CM_WRITER_BUFSZ);
+
+    // a regular file is written next to where it goes and renamed over it at
+    // the end. anything else, like a pipe, a symlink or /dev/stdout, cannot
+    // be replaced like that, so it is written in place as it goes, like
+    // stdout is.
+    struct stat st;
+    if (lstat(filename, &st) == 0 && !S_ISREG(st.st_mode)) {
+        res.writer_state.fd = open(filename, O_WRONLY | O_TRUNC);
+        if (res.writer_state.fd < 0) {
+            perror("open");
+            as_free(&res.writer_state.buf);
+            return false;
+        }
+
+        *out = res;
+        return true;
+    }
+
+    a_string tmp = astr(filename);
+    as_append(&tmp, ".XXXXXX");
+    int fd = mkstemp(tmp.data);
+    if (fd < 0) {
+        perror("mkstemp");
+        as_free(&tmp);
+        as_free(&res.writer_state.buf);
         return false;
     }
 
-    Compiler res = {0};
-    res.writer_state.fp = ptr;
-    res.writer_state.mode = CM_WRITER_MODE_FILE;
+    // mkstemp makes it private, but it should end up like any new file
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+
+    res.writer_state.fd = fd;
+    res.writer_state.path = astr(filename);
+    res.writer_state.tmp_path = tmp;
 
     *out = res;
     return true;
@@ -51,29 +93,41 @@ Compiler cm_new_with_string_writer() {
 }
 
 void cm_free(Compiler* c) {
-    switch (c->writer_state.mode) {
-        case CM_WRITER_MODE_FILE: {
-            fclose(c->writer_state.fp);
-        } break;
-        case CM_WRITER_MODE_STRING: {
-            as_free(&c->writer_state.buf);
-        } break;
-        default: break;
-    }
+    // whatever is still buffered is thrown away, unwritten
+    CompilerWriterState* w = &c->writer_state;
+    if (w->mode == CM_WRITER_MODE_FILE)
+        close(w->fd);
+    if (w->tmp_path.len)
+        unlink(w->tmp_path.data);
+    as_free(&w->buf);
+    as_free(&w->path);
+    as_free(&w->tmp_path);
 
     for (usize i = 0; i < c->ss.len; i++) {
         as_free(&c->ss.data[i]);
     }
 
     av_free(&c->ss);
+    sy_free(&c->syms);
+    free(c->known);
+    free(c->known_gen);
+    free(c->folds);
+    free(c->folds_gen);
+    free(c->types);
+    ar_free(&c->fold_arena);
+    ar_free(&c->const_arena);
 }
 
 void cm_diag(Compiler* c, Pos pos, const char* restrict format, ...) {
+    LineCol lc = {0};
+    if (c->lines)
+        lc = li_locate(c->lines, pos.offset);
+
     if (c->file_name.data) {
         eprintf("\033[31;1merror: \033[0;1m%.*s:%u:%u: \033[0m",
-                (int)c->file_name.len, c->file_name.data, pos.row, pos.col);
+                (int)c->file_name.len, c->file_name.data, lc.row, lc.col);
     } else {
-        eprintf("\033[31;1merror: \033[0;1m%u:%u: \033[0m", pos.row, pos.col);
+        eprintf("\033[31;1merror: \033[0;1m%u:%u: \033[0m", lc.row, lc.col);
     }
 
     va_list args;
@@ -82,85 +136,133 @@ void cm_diag(Compiler* c, Pos pos, const char* restrict format, ...) {
     va_end(args);
 
     fputc('\n', stderr);
+    if (c->lines && pos.span)
+        li_print_span(c->lines, pos);
 
     c->error_count++;
 }
 
 // writer functions
 
-void cm_write(Compiler* c, const char* s) {
-    switch (c->writer_state.mode) {
-        case CM_WRITER_MODE_STDOUT: {
-            printf("%s", s);
-        } break;
-        case CM_WRITER_MODE_FILE: {
-            fprintf(c->writer_state.fp, "%s", s);
-        } break;
-        case CM_WRITER_MODE_STRING: {
-            as_append_cstr(&c->writer_state.buf, s);
-        } break;
+static bool cm_flush(Compiler* c) {
+    CompilerWriterState* w = &c->writer_state;
+
+    // anything printed with stdio so far goes first
+    if (w->mode == CM_WRITER_MODE_STDOUT)
+        fflush(stdout);
+
+    for (usize done = 0; done < w->buf.len && !w->error;) {
+        ssize_t n = write(w->fd, &w->buf.data[done], w->buf.len - done);
+        if (n < 0 && errno != EINTR)
+            w->error = errno;
+        else if (n > 0)
+            done += n;
     }
+
+    // after an error the rest of the output is thrown away
+    w->buf.len = 0;
+    if (w->error)
+        errno = w->error;
+    return !w->error;
 }
 
-void cm_writeln(Compiler* c, const char* s) {
-    switch (c->writer_state.mode) {
-        case CM_WRITER_MODE_STDOUT: {
-            printf("%s\n", s);
-        } break;
-        case CM_WRITER_MODE_FILE: {
-            fprintf(c->writer_state.fp, "%s\n", s);
-        } break;
-        case CM_WRITER_MODE_STRING: {
-            as_append_cstr(&c->writer_state.buf, s);
-            as_append_char(&c->writer_state.buf, '\n');
-        } break;
+bool cm_commit(Compiler* c) {
+    CompilerWriterState* w = &c->writer_state;
+    if (w->mode == CM_WRITER_MODE_STRING)
+        return true;
+
+    if (!cm_flush(c))
+        return false;
+    if (!w->tmp_path.len)
+        return true;
+
+    if (rename(w->tmp_path.data, w->path.data) < 0) {
+        w->error = errno;
+        return false;
+    }
+
+    // it is not ours to remove any more
+    as_free(&w->tmp_path);
+    return true;
+}
+
+// room for len more bytes and a null terminator
+char* cm_reserve(Compiler* c, usize len) {
+    a_string* buf = &c->writer_state.buf;
+    if (buf->len + len + 1 > buf->cap) {
+        usize cap = buf->cap * 2;
+        while (buf->len + len + 1 > cap)
+            cap *= 2;
+        as_reserve(buf, cap);
     }
+
+    return &buf->data[buf->len];
+}
+
+static void cm_append(Compiler* c, const char* s, usize len) {
+    memcpy(cm_reserve(c, len), s, len);
+    c->writer_state.buf.len += len;
+    c->writer_state.buf.data[c->writer_state.buf.len] = '\0';
+}
+
+static void cm_vwritef(Compiler* c, const char* restrict format,
+                       va_list lst) {
+    a_string* buf = &c->writer_state.buf;
+    va_list again;
+    va_copy(again, lst);
+
+    // formatted straight into the buffer, and again if it did not fit
+    usize room = buf->cap - buf->len;
+    int len = vsnprintf(&buf->data[buf->len], room, format, lst);
+    if (len > 0 && (usize)len >= room)
+        vsnprintf(cm_reserve(c, len), len + 1, format, again);
+    if (len > 0)
+        buf->len += len;
+
+    va_end(again);
+}
+
+// flushes once the buffer is full enough. a file that is renamed into place
+// can take it, as nothing shows up where it goes before cm_commit.
+static void cm_written(Compiler* c) {
+    const CompilerWriterState* w = &c->writer_state;
+    if (w->mode != CM_WRITER_MODE_STRING && w->buf.len >= CM_WRITER_BUFSZ)
+        cm_flush(c);
+}
+
+void cm_wrote(Compiler* c, char* end) {
+    a_string* buf = &c->writer_state.buf;
+    buf->len = end - buf->data;
+    buf->data[buf->len] = '\0';
+    cm_written(c);
+}
+
+void cm_write(Compiler* c, const char* s) {
+    cm_append(c, s, strlen(s));
+    cm_written(c);
 }
 
-#define CM_WRITEF_MAXSIZE 1024
-static char writef_buf[CM_WRITEF_MAXSIZE] = {0};
+void cm_writeln(Compiler* c, const char* s) {
+    cm_append(c, s, strlen(s));
+    cm_append(c, "\n", 1);
+    cm_written(c);
+}
 
 void cm_writef(Compiler* c, const char* restrict format, ...) {
     va_list lst;
     va_start(lst, format);
-
-    switch (c->writer_state.mode) {
-        case CM_WRITER_MODE_STDOUT: {
-            vprintf(format, lst);
-        } break;
-        case CM_WRITER_MODE_FILE: {
-            vfprintf(c->writer_state.fp, format, lst);
-        } break;
-        case CM_WRITER_MODE_STRING: {
-            vsnprintf(writef_buf, CM_WRITEF_MAXSIZE - 1, format, lst);
-            as_append_cstr(&c->writer_state.buf, writef_buf);
-        } break;
-    }
-
+    cm_vwritef(c, format, lst);
     va_end(lst);
+    cm_written(c);
 }
 
 void cm_writefln(Compiler* c, const char* restrict format, ...) {
     va_list lst;
     va_start(lst, format);
-
-    switch (c->writer_state.mode) {
-        case CM_WRITER_MODE_STDOUT: {
-            vprintf(format, lst);
-            putchar('\n');
-        } break;
-        case CM_WRITER_MODE_FILE: {
-            vfprintf(c->writer_state.fp, format, lst);
-            fprintf(c->writer_state.fp, "\n");
-        } break;
-        case CM_WRITER_MODE_STRING: {
-            vsnprintf(writef_buf, CM_WRITEF_MAXSIZE - 1, format, lst);
-            as_append_cstr(&c->writer_state.buf, writef_buf);
-            as_append_char(&c->writer_state.buf, '\n');
-        } break;
-    }
-
+    cm_vwritef(c, format, lst);
     va_end(lst);
+    cm_append(c, "\n", 1);
+    cm_written(c);
 }
 
 #define TYPE_STRING_BUFSZ 64
@@ -171,11 +273,12 @@ static const char* PRIM_TYPE_TABLE[] = {
     [CB_PRIM_CHAR] = "CHAR", [CB_PRIM_STRING] = "STRING",
 };
 
+// primitive names are returned as they are, so that two of them can be used
+// in the same message
 const char* type_string(CB_Type t) {
     if (inrange(t, CB_PRIM_NULL, CB_PRIM_STRING))
-        strcpy(type_string_buf, PRIM_TYPE_TABLE[t]);
-    else
-        snprintf(type_string_buf, TYPE_STRING_BUFSZ, "Type %u", (u32)t);
+        return PRIM_TYPE_TABLE[t];
 
+    snprintf(type_string_buf, TYPE_STRING_BUFSZ, "Type %u", (u32)t);
     return type_string_buf;
 }
@@ -12,8 +12,12 @@
 #define _COMPILER_H
 
 #include "../a_vector.h"
+#include "../arena.h"
 #include "../ast.h"
+#include "../atom.h"
 #include "../common.h"
+#include "../lines.h"
+#include "../symbols.h"
 
 typedef enum {
     CM_WRITER_MODE_STDOUT = 0,
@@ -24,29 +28,79 @@ typedef enum {
 // array of owned slices
 AV_DECL(a_string, StringStorage)
 
+// what the type pass found out about an expression
+typedef struct {
+    CB_Type type; // CB_PRIM_NULL if it had an error
+    u8 conv;      // CM_CONV_*, for the operands of a binary
+    u32 gen;      // only good while this is the compiler's type_gen
+} CmTypeInfo;
+
+// operands that have to be made real before a binary is done on them
+#define CM_CONV_LHS_REAL 1
+#define CM_CONV_RHS_REAL 2
+
 typedef struct {
     CompilerWriterMode mode;
-    union {
-        FILE* fp; // NULL if file writer not used
-        a_string buf;
-    };
+    int fd; // for the stdout and file writers
+    // what was written but not flushed yet. the string writer never
+    // flushes, so for it this is everything that was written.
+    a_string buf;
+    int error; // errno of the first flush that failed, or 0
+    // the file writer writes to tmp_path, and renames it to path in
+    // cm_commit. both are empty when it writes straight to the file.
+    a_string path;
+    a_string tmp_path;
 } CompilerWriterState;
 
+typedef struct {
+    u64 id;
+    CB_Type kind; // 4 bytes
+    bool have;    // if set to false, it is invalid and there was an error.
+} Val;
+
 typedef struct {
     CompilerWriterState writer_state;
     StringStorage ss;
+    // where the expressions being compiled live, not owned
+    const CB_Exprs* exprs;
+    // the names of its identifiers, not owned
+    const AtomTable* atoms;
+    // what is in scope. a symbol's id is the register holding a constant's
+    // value, or the one pointing at a variable's stack slot.
+    SymbolTable syms;
+    // the strings of constants whose values are known
+    Arena const_arena;
+    Pos scope_pos; // of the outermost SCOPE still open
     a_string file_name;
+    LineIndex* lines; // NULL if not specified
     usize string_id;
     usize label_id;
     usize id;
     u32 error_count;
-} Compiler;
 
-typedef struct {
-    u64 id;
-    CB_Type kind; // 4 bytes
-    bool have;    // if set to false, it is invalid and there was an error.
-} Val;
+    // values of pure expressions already worked out, by cb_expr_same id, so
+    // that equal ones are not computed again. an entry is only good while
+    // its known_gen is gen, which is never 0.
+    Val* known;
+    u32* known_gen;
+    usize known_cap;
+    u32 gen;
+
+    // values of the current statement's expressions that are known before
+    // it runs, by id. an entry is only good while its folds_gen is fold_gen,
+    // which is never 0 once a statement was folded. strings made by folding
+    // live in fold_arena.
+    CB_Value* folds;
+    u32* folds_gen;
+    usize folds_cap;
+    u32 fold_gen;
+    Arena fold_arena;
+
+    // types of the current statement's expressions, by id
+    CmTypeInfo* types;
+    usize types_cap;
+    u32 type_gen;
+} Compiler;
 
 Compiler cm_new(void);
 void cm_free(Compiler* c);
@@ -55,10 +109,29 @@ void cm_diag(Compiler* c, Pos pos, const char* restrict format, ...);
 
 bool cm_new_with_file_writer(const char* filename, Compiler* out);
 Compiler cm_new_with_string_writer();
+// writes out everything buffered so far and puts the output file in place.
+// without it, cm_free throws away what is still buffered, and a file that is
+// renamed into place is never put there. stdout and outputs that are written
+// in place keep what was flushed before. returns false and leaves errno set
+// if any of the output could not be written.
+bool cm_commit(Compiler* c);
 
-Val cm_expr(Compiler* c, CB_Expr* e);
+Val cm_expr(Compiler* c, CB_ExprId e);
+// s must have been checked first, like cm_program_stmt does
 void cm_stmt(Compiler* c, CB_Stmt* s);
-// NULL file name: not specified
-bool cm_program(Compiler* c, CB_Program* prog, a_string* file_name);
+// NULL file name or lines: not specified
+bool cm_program(Compiler* c, CB_Program* prog, a_string* file_name,
+                LineIndex* lines);
+
+// cm_program in pieces, for compiling statements as soon as they are parsed:
+// begin once, then each statement in order, then end once. the statements'
+// expressions must be in exprs, and their names in atoms. cm_program_stmt
+// returns false once there are too many errors, and nothing more should be
+// compiled after that.
+void cm_program_begin(Compiler* c, const CB_Exprs* exprs,
+                      const AtomTable* atoms, a_string* file_name,
+                      LineIndex* lines);
+bool cm_program_stmt(Compiler* c, CB_Stmt* s);
+bool cm_program_end(Compiler* c);
 
 #endif // _COMPILER_H
@@ -18,13 +18,110 @@ void cm_write(Compiler* c, const char* s);
 void cm_writeln(Compiler* c, const char* s);
 void cm_writef(Compiler* c, const char* restrict format, ...);
 void cm_writefln(Compiler* c, const char* restrict format, ...);
+// room for at least len more bytes of output, to be written straight into.
+// the write is ended with cm_wrote, at the byte after the last one written.
+char* cm_reserve(Compiler* c, usize len);
+void cm_wrote(Compiler* c, char* end);
+
+// typed instruction emitters, see emit.c. each writes one whole line.
+
+typedef enum {
+    CM_OP_COPY = 0,
+    CM_OP_ADD,
+    CM_OP_SUB,
+    CM_OP_MUL,
+    CM_OP_DIV,
+    CM_OP_NEG,
+    CM_OP_XOR,
+    CM_OP_CEQW,
+    CM_OP_SLTOF,
+    CM_OP_LOADW,
+    CM_OP_LOADL,
+    CM_OP_LOADD,
+} CmOp;
+
+typedef enum {
+    CM_ARG_TEMP = 0,
+    CM_ARG_INT,
+    CM_ARG_GLOBAL,
+    CM_ARG_VARIADIC, // the ... before a variadic function's variable args
+} CmArgKind;
+
+typedef struct {
+    CmArgKind kind;
+    char cls;           // w, l, s or d
+    u64 value;          // the temporary, or the integer
+    const char* global; // without the $
+} CmArg;
+
+#define cm_arg_temp(k, t)                                                      \
+    (CmArg) {                                                                  \
+        .kind = CM_ARG_TEMP, .cls = (k), .value = (t)                          \
+    }
+#define cm_arg_int(k, v)                                                       \
+    (CmArg) {                                                                  \
+        .kind = CM_ARG_INT, .cls = (k), .value = (u64)(v)                      \
+    }
+#define cm_arg_global(k, name)                                                 \
+    (CmArg) {                                                                  \
+        .kind = CM_ARG_GLOBAL, .cls = (k), .global = (name)                    \
+    }
+#define CM_ARG_VARARGS                                                         \
+    (CmArg) {                                                                  \
+        .kind = CM_ARG_VARIADIC                                                \
+    }
+
+// %rdst =cls copy v
+void cm_emit_copy_int(Compiler* c, usize dst, char cls, i64 v);
+// %rdst =d copy d_v
+void cm_emit_copy_real(Compiler* c, usize dst, f64 v);
+// %rdst =l copy $__S<string_id>
+void cm_emit_copy_string(Compiler* c, usize dst, usize string_id);
+// %rdst =cls op %ra
+void cm_emit_unop(Compiler* c, usize dst, char cls, CmOp op, usize a);
+// %rdst =cls op %ra, %rb
+void cm_emit_binop(Compiler* c, usize dst, char cls, CmOp op, usize a,
+                   usize b);
+// %rdst =cls op %ra, b
+void cm_emit_binop_imm(Compiler* c, usize dst, char cls, CmOp op, usize a,
+                       u64 b);
+// %rdst =l alloc8 size
+void cm_emit_alloc(Compiler* c, usize dst, usize size);
+// storecls %rvalue, %raddr
+void cm_emit_store(Compiler* c, char cls, usize value, usize addr);
+// call $fn(args...)
+void cm_emit_call(Compiler* c, const char* fn, const CmArg* args, usize len);
+// the data for string literal id, s stopping at len bytes
+void cm_emit_data_string(Compiler* c, usize id, const char* s, usize len);
 const char* type_string(CB_Type t);
+// the class of the registers that hold each primitive type
+extern const char TYPE_TABLE[];
+// puts v in a new register
+Val cm_literal(Compiler* c, const CB_Value* v);
+// promotes an integer to a real
+Val cm_to_real(Compiler* c, Val v);
+// drops every value worked out so far, once something could have changed a
+// variable or control could have come from elsewhere
+void cm_forget_values(Compiler* c);
+// works out the type of every expression in s that was not folded, and the
+// promotions each needs, before any of it is compiled. s must have been
+// folded first. returns false if it reported errors, or if s has something
+// that cannot be compiled yet, and then s must not be compiled.
+bool cm_check_stmt(Compiler* c, CB_Stmt* s);
+// what cm_check_stmt found for e in the current statement
+CmTypeInfo cm_type_of(const Compiler* c, CB_ExprId e);
+// works out every expression in s that can be before it runs, including
+// constants, with the same promotions cm_binary does
+void cm_fold_stmt(Compiler* c, CB_Stmt* s);
+// the value of e if it was folded for the current statement, or NULL
+const CB_Value* cm_folded(const Compiler* c, CB_ExprId e);
 
 #define val(id, t)                                                             \
     (Val) {                                                                    \
         .have = 1, .id = (id), .kind = (t)                                     \
     }
 
-#define BEGIN_POS (Pos){.col = 1, .row = 1}
+// not anywhere in particular
+#define BEGIN_POS (Pos){0}
 
 #endif
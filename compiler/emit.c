@@ -0,0 +1,244 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h> // used in macro
+#include <string.h>
+
+#include "../common.h"
+#include "compiler.h"
+#include "compiler_internal.h"
+
+// instructions are put together straight in the output buffer, without going
+// through format strings. every piece has a known longest length, so room
+// for a whole line is reserved once, up front.
+
+typedef struct {
+    const char* s;
+    u8 len;
+} OpName;
+
+#define OP(s) {s, sizeof(s) - 1}
+static const OpName OP_NAMES[] = {
+    [CM_OP_COPY] = OP("copy"),   [CM_OP_ADD] = OP("add"),
+    [CM_OP_SUB] = OP("sub"),     [CM_OP_MUL] = OP("mul"),
+    [CM_OP_DIV] = OP("div"),     [CM_OP_NEG] = OP("neg"),
+    [CM_OP_XOR] = OP("xor"),     [CM_OP_CEQW] = OP("ceqw"),
+    [CM_OP_SLTOF] = OP("sltof"), [CM_OP_LOADW] = OP("loadw"),
+    [CM_OP_LOADL] = OP("loadl"), [CM_OP_LOADD] = OP("loadd"),
+};
+#undef OP
+
+// the longest a u64 gets in decimal
+#define U64_DIGITS 20
+// the longest a temporary, a class or an opcode can be, with the punctuation
+// around them
+#define EMIT_TEMP_MAX (2 + U64_DIGITS)
+#define EMIT_LINE_MAX (3 * EMIT_TEMP_MAX + 32)
+
+// two digits at a time, from the end
+static const char DIGIT_PAIRS[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+static char* put_u64(char* p, u64 v) {
+    char tmp[U64_DIGITS];
+    char* end = &tmp[U64_DIGITS];
+    char* q = end;
+
+    while (v >= 100) {
+        q -= 2;
+        memcpy(q, &DIGIT_PAIRS[(v % 100) * 2], 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        q -= 2;
+        memcpy(q, &DIGIT_PAIRS[v * 2], 2);
+    } else {
+        *--q = '0' + v;
+    }
+
+    memcpy(p, q, end - q);
+    return p + (end - q);
+}
+
+static char* put_i64(char* p, i64 v) {
+    if (v >= 0)
+        return put_u64(p, v);
+
+    *p++ = '-';
+    return put_u64(p, 0 - (u64)v);
+}
+
+static char* put_str(char* p, const char* s, usize len) {
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static char* put_temp(char* p, usize t) {
+    *p++ = '%';
+    *p++ = 'r';
+    return put_u64(p, t);
+}
+
+// "%rdst =c op "
+static char* put_head(char* p, usize dst, char cls, CmOp op) {
+    p = put_temp(p, dst);
+    *p++ = ' ';
+    *p++ = '=';
+    *p++ = cls;
+    *p++ = ' ';
+    p = put_str(p, OP_NAMES[op].s, OP_NAMES[op].len);
+    *p++ = ' ';
+    return p;
+}
+
+static char* put_end(char* p) {
+    *p++ = '\n';
+    return p;
+}
+
+void cm_emit_copy_int(Compiler* c, usize dst, char cls, i64 v) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_head(p, dst, cls, CM_OP_COPY);
+    p = put_i64(p, v);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_copy_real(Compiler* c, usize dst, f64 v) {
+    // the one thing still left to printf, since its digits have to match
+    // what strtod reads back exactly
+    char num[32];
+    int len = snprintf(num, sizeof(num), "d_%.17g", v);
+
+    char* p = cm_reserve(c, EMIT_LINE_MAX + len);
+    p = put_head(p, dst, 'd', CM_OP_COPY);
+    p = put_str(p, num, len);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_copy_string(Compiler* c, usize dst, usize string_id) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_head(p, dst, 'l', CM_OP_COPY);
+    p = put_str(p, "$__S", 4);
+    p = put_u64(p, string_id);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_unop(Compiler* c, usize dst, char cls, CmOp op, usize a) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_head(p, dst, cls, op);
+    p = put_temp(p, a);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_binop(Compiler* c, usize dst, char cls, CmOp op, usize a,
+                   usize b) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_head(p, dst, cls, op);
+    p = put_temp(p, a);
+    *p++ = ',';
+    *p++ = ' ';
+    p = put_temp(p, b);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_binop_imm(Compiler* c, usize dst, char cls, CmOp op, usize a,
+                       u64 b) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_head(p, dst, cls, op);
+    p = put_temp(p, a);
+    *p++ = ',';
+    *p++ = ' ';
+    p = put_u64(p, b);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_alloc(Compiler* c, usize dst, usize size) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_temp(p, dst);
+    p = put_str(p, " =l alloc8 ", 11);
+    p = put_u64(p, size);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_store(Compiler* c, char cls, usize value, usize addr) {
+    char* p = cm_reserve(c, EMIT_LINE_MAX);
+    p = put_str(p, "store", 5);
+    *p++ = cls;
+    *p++ = ' ';
+    p = put_temp(p, value);
+    *p++ = ',';
+    *p++ = ' ';
+    p = put_temp(p, addr);
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_call(Compiler* c, const char* fn, const CmArg* args, usize len) {
+    usize fn_len = strlen(fn);
+    usize room = fn_len + 16;
+    for (usize i = 0; i < len; i++) {
+        room += EMIT_TEMP_MAX + 8;
+        if (args[i].global)
+            room += strlen(args[i].global);
+    }
+
+    char* p = cm_reserve(c, room);
+    p = put_str(p, "call $", 6);
+    p = put_str(p, fn, fn_len);
+    *p++ = '(';
+
+    for (usize i = 0; i < len; i++) {
+        if (i) {
+            *p++ = ',';
+            *p++ = ' ';
+        }
+
+        const CmArg* a = &args[i];
+        if (a->kind == CM_ARG_VARIADIC) {
+            p = put_str(p, "...", 3);
+            continue;
+        }
+
+        *p++ = a->cls;
+        *p++ = ' ';
+        switch (a->kind) {
+            case CM_ARG_TEMP: p = put_temp(p, a->value); break;
+            case CM_ARG_INT: p = put_i64(p, (i64)a->value); break;
+            case CM_ARG_GLOBAL: {
+                *p++ = '$';
+                p = put_str(p, a->global, strlen(a->global));
+            } break;
+            default: break;
+        }
+    }
+
+    *p++ = ')';
+    cm_wrote(c, put_end(p));
+}
+
+void cm_emit_data_string(Compiler* c, usize id, const char* s, usize len) {
+    // TODO: escape sequences
+    char* p = cm_reserve(c, EMIT_TEMP_MAX + len + 32);
+    p = put_str(p, "data $__S", 9);
+    p = put_u64(p, id);
+    p = put_str(p, " = align 1 { b \"", 16);
+    p = put_str(p, s, len);
+    p = put_str(p, "\", b 0 }\n\n", 10);
+    cm_wrote(c, p);
+}
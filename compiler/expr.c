@@ -11,37 +11,40 @@
 
 #include <stdarg.h>
 #include <stdlib.h> // used in macro
+#include <string.h>
 
 #include "../a_string.h"
 #include "../a_vector.h"
 #include "../ast.h"
+#include "../atom.h"
 #include "../common.h"
+#include "../symbols.h"
 #include "compiler.h"
 #include "compiler_internal.h"
 
-static Val cm_literal(Compiler* c, CB_Value* e) {
+Val cm_literal(Compiler* c, const CB_Value* e) {
     usize id = c->id++;
 
     switch (e->kind) {
         case CB_PRIM_STRING: {
             av_append(&c->ss, as_slice_cstr(e->string.data, 0, e->string.len));
-            cm_writefln(c, "%%r%zu =l copy $__S%zu", id, c->string_id++);
+            cm_emit_copy_string(c, id, c->string_id++);
             return val(id, CB_PRIM_STRING);
         } break;
         case CB_PRIM_INTEGER: {
-            cm_writefln(c, "%%r%zu =l copy %li", id, e->integer);
+            cm_emit_copy_int(c, id, 'l', e->integer);
             return val(id, CB_PRIM_INTEGER);
         } break;
         case CB_PRIM_REAL: {
-            cm_writefln(c, "%%r%zu =d copy d_%g", id, e->real);
+            cm_emit_copy_real(c, id, e->real);
             return val(id, CB_PRIM_REAL);
         } break;
         case CB_PRIM_BOOLEAN: {
-            cm_writefln(c, "%%r%zu =w copy %d", id, e->boolean);
+            cm_emit_copy_int(c, id, 'w', e->boolean);
             return val(id, CB_PRIM_BOOLEAN);
         } break;
         case CB_PRIM_CHAR: {
-            cm_writefln(c, "%%r%zu =w copy %d", id, e->chr);
+            cm_emit_copy_int(c, id, 'w', e->chr);
             return val(id, CB_PRIM_CHAR);
         } break;
         default: {
@@ -56,50 +59,39 @@ static Val cm_literal(Compiler* c, CB_Value* e) {
     panic("not implemented");
 }
 
-Val cm_unary(Compiler* c, CB_Expr* e) {
-    Val inner = cm_expr(c, e->unary);
+const char TYPE_TABLE[] = {
+    [CB_PRIM_NULL] = 'w', [CB_PRIM_INTEGER] = 'l',
+    [CB_PRIM_REAL] = 'd', [CB_PRIM_BOOLEAN] = 'w',
+    [CB_PRIM_CHAR] = 'w', [CB_PRIM_STRING] = 'l', // TODO: string stuff
+};
+
+// the operand types of every expression were checked by cm_check_stmt
+// before any of it is compiled, so nothing here looks at them again
+
+Val cm_unary(Compiler* c, CB_ExprId e) {
+    CB_ExprKind k = c->exprs->kinds[e];
+    Val inner = cm_expr(c, c->exprs->data[e].unary);
     if (!inner.have)
-        goto fail;
+        return (Val){0};
 
-    Pos pos = e->unary->pos;
-    usize id;
-    if (e->kind != CB_EXPR_GROUPING)
-        id = c->id++;
+    // a grouping is just its operand
+    if (k == CB_EXPR_GROUPING)
+        return inner;
 
-    switch (e->kind) {
-        case CB_EXPR_NEGATION: {
-            if (inner.kind != CB_PRIM_INTEGER && inner.kind != CB_PRIM_REAL) {
-                cm_diag(c, pos, "cannot negate a value of type %s",
-                        type_string(inner.kind));
-                goto fail;
-            }
+    usize id = c->id++;
 
+    switch (k) {
+        case CB_EXPR_NEGATION: {
             if (inner.kind == CB_PRIM_REAL)
-                cm_writefln(c, "%%r%zu =d neg %%r%zu", id, inner.id);
+                cm_emit_unop(c, id, 'd', CM_OP_NEG, inner.id);
             else if (inner.kind == CB_PRIM_INTEGER)
-                cm_writefln(c, "%%r%zu =l neg %%r%zu", id, inner.id);
+                cm_emit_unop(c, id, 'l', CM_OP_NEG, inner.id);
         } break;
         case CB_EXPR_NOT: {
-            if (inner.kind != CB_PRIM_BOOLEAN) {
-                cm_diag(c, pos, "cannot do boolean NOT on a value of type %s",
-                        type_string(inner.kind));
-                goto fail;
-            }
-
-            cm_writefln(c, "%%r%zu =w ceqw %%r%zu, 0", id, inner.id);
+            cm_emit_binop_imm(c, id, 'w', CM_OP_CEQW, inner.id, 0);
         } break;
         case CB_EXPR_BITNOT: {
-            if (inner.kind == CB_PRIM_STRING || inner.kind > CB_PRIM_CUSTOM) {
-                cm_diag(c, pos, "cannot do bitwise NOT on a value of type %s",
-                        type_string(inner.kind));
-                goto fail;
-            }
-
-            cm_writefln(c, "%%r%zu =l xor %%r%zu, 18446744073709551615", id,
-                        inner.id);
-        } break;
-        case CB_EXPR_GROUPING: {
-            // we don't actually need anything
+            cm_emit_binop_imm(c, id, 'l', CM_OP_XOR, inner.id, (u64)-1);
         } break;
         case CB_EXPR_TYPECAST: {
             panic("not implemented");
@@ -117,129 +109,47 @@ Val cm_unary(Compiler* c, CB_Expr* e) {
     }
 
     return val(id, inner.kind);
-fail:
-    return (Val){0};
 }
 
-#define kind_is_numeric(k) ((k) == CB_PRIM_INTEGER || (k) == CB_PRIM_REAL)
-
-const char TYPE_TABLE[] = {
-    [CB_PRIM_NULL] = 'w', [CB_PRIM_INTEGER] = 'l',
-    [CB_PRIM_REAL] = 'd', [CB_PRIM_BOOLEAN] = 'w',
-    [CB_PRIM_CHAR] = 'w', [CB_PRIM_STRING] = 'l', // TODO: string stuff
-};
-
-Val cm_binary(Compiler* c, CB_Expr* e) {
-    Val lhs = cm_expr(c, e->lhs), rhs = cm_expr(c, e->rhs);
-    Pos lhs_pos = e->lhs->pos, rhs_pos = e->rhs->pos;
-
-    if (!lhs.have)
-        goto fail;
-
-    if (!rhs.have)
-        goto fail;
-
-    if (lhs.kind > CB_PRIM_CUSTOM || rhs.kind > CB_PRIM_CUSTOM) {
-        cm_diag(c, e->pos, "custom types not implemented for binary exprs!");
-        goto fail;
-    }
-
-    switch (e->kind) {
-        case CB_EXPR_ADD: {
-            if (lhs.kind == CB_PRIM_STRING || rhs.kind == CB_PRIM_STRING) {
-                panic("string concatenation not implemented");
-                goto start_compiling; // we don't wanna trigger the bottom
-                                      // numeric check
-            }
-        } // fallthrough
-        case CB_EXPR_SUB:
-        case CB_EXPR_MUL:
-        case CB_EXPR_DIV:
-        case CB_EXPR_POW:
-        case CB_EXPR_LT:
-        case CB_EXPR_GT:
-        case CB_EXPR_LEQ:
-        case CB_EXPR_GEQ: {
-            if (!kind_is_numeric(lhs.kind) || !kind_is_numeric(rhs.kind))
-                goto type_error;
-        } break;
-        case CB_EXPR_SHL:
-        case CB_EXPR_SHR: {
-            if (lhs.kind != CB_PRIM_INTEGER || rhs.kind != CB_PRIM_INTEGER)
-                goto type_error;
-        } break;
-        case CB_EXPR_AND:
-        case CB_EXPR_OR: {
-            if (lhs.kind != CB_PRIM_BOOLEAN || rhs.kind != CB_PRIM_BOOLEAN)
-                goto type_error;
-        } break;
-        case CB_EXPR_BITOR:
-        case CB_EXPR_BITAND:
-        case CB_EXPR_BITXOR: {
-            panic("not implemented");
-        } break;
-        default: {
-            panic("not implemented");
-        } break;
-    }
-
-start_compiling:
+// integer-real promotion, where the type pass found one is needed
+Val cm_to_real(Compiler* c, Val v) {
     usize id = c->id++;
+    cm_emit_unop(c, id, 'd', CM_OP_SLTOF, v.id);
+    return val(id, CB_PRIM_REAL);
+}
 
-    // gotta figure the types out
-    CB_Type res_kind = lhs.kind;
-    char ct = TYPE_TABLE[res_kind];
-
-    // do integer-real promotion
-    // if it happens, we steal the current id and make a new one
-    if (lhs.kind == CB_PRIM_INTEGER && rhs.kind == CB_PRIM_REAL) {
-        lhs.kind = CB_PRIM_REAL;
-
-        cm_writefln(c, "%%r%zu =d sltof %%r%zu", id, lhs.id);
-        lhs.id = id++; // we need a new one afterwards
-
-        res_kind = CB_PRIM_REAL;
-        ct = TYPE_TABLE[CB_PRIM_REAL];
-    } else if (lhs.kind == CB_PRIM_REAL && rhs.kind == CB_PRIM_INTEGER) {
-        rhs.kind = CB_PRIM_REAL;
+Val cm_binary(Compiler* c, CB_ExprId e) {
+    CB_ExprKind k = c->exprs->kinds[e];
+    CB_ExprData d = c->exprs->data[e];
+    Val lhs = cm_expr(c, d.lhs), rhs = cm_expr(c, d.rhs);
+    if (!lhs.have || !rhs.have)
+        return (Val){0};
 
-        cm_writefln(c, "%%r%zu =d sltof %%r%zu", id, rhs.id);
-        rhs.id = id++; // we need a new one now
+    CmTypeInfo t = cm_type_of(c, e);
+    if (t.conv & CM_CONV_LHS_REAL)
+        lhs = cm_to_real(c, lhs);
+    if (t.conv & CM_CONV_RHS_REAL)
+        rhs = cm_to_real(c, rhs);
 
-        res_kind = CB_PRIM_REAL;
-        ct = TYPE_TABLE[CB_PRIM_REAL];
-    }
+    usize id = c->id++;
+    char ct = TYPE_TABLE[lhs.kind];
 
-    switch (e->kind) {
+    switch (k) {
         case CB_EXPR_ADD: {
-            if (lhs.kind == CB_PRIM_STRING || rhs.kind == CB_PRIM_STRING) {
+            if (lhs.kind == CB_PRIM_STRING) {
                 panic("string concatenation not implemented");
             }
 
-            cm_writefln(c, "%%r%zu =%c add %%r%zu, %%r%zu", id, ct, lhs.id,
-                        rhs.id);
+            cm_emit_binop(c, id, ct, CM_OP_ADD, lhs.id, rhs.id);
         } break;
         case CB_EXPR_SUB: {
-            cm_writefln(c, "%%r%zu =%c sub %%r%zu, %%r%zu", id, ct, lhs.id,
-                        rhs.id);
+            cm_emit_binop(c, id, ct, CM_OP_SUB, lhs.id, rhs.id);
         } break;
         case CB_EXPR_MUL: {
-            cm_writefln(c, "%%r%zu =%c mul %%r%zu, %%r%zu", id, ct, lhs.id,
-                        rhs.id);
+            cm_emit_binop(c, id, ct, CM_OP_MUL, lhs.id, rhs.id);
         } break;
         case CB_EXPR_DIV: {
-            if (lhs.kind == CB_PRIM_INTEGER) {
-                lhs.kind = CB_PRIM_REAL;
-                cm_writefln(c, "%%r%zu =d sltof %%r%zu", id, lhs.id);
-                lhs.id = id++;
-            }
-            if (rhs.kind == CB_PRIM_INTEGER) {
-                rhs.kind = CB_PRIM_REAL;
-                cm_writefln(c, "%%r%zu =d sltof %%r%zu", id, rhs.id);
-                rhs.id = id++;
-            }
-            res_kind = CB_PRIM_REAL;
-            cm_writefln(c, "%%r%zu =d div %%r%zu, %%r%zu", id, lhs.id, rhs.id);
+            cm_emit_binop(c, id, 'd', CM_OP_DIV, lhs.id, rhs.id);
         } break;
         case CB_EXPR_POW: {
             panic("not implemented");
@@ -286,24 +196,74 @@ start_compiling:
         default: panic("tried to compile non binary expr as binary");
     }
 
-    return val(id, res_kind);
-type_error:
-    cm_diag(c, e->pos,
-            "cannot perform binary operation %s with types %s and %s!",
-            expr_kind_string(e->kind), type_string(lhs.kind),
-            type_string(rhs.kind));
-fail:
-    return (Val){0};
+    return val(id, t.type);
 }
 
-Val cm_expr(Compiler* c, CB_Expr* e) {
-    if (cb_expr_kind_is_unary(e->kind)) {
-        return cm_unary(c, e);
-    } else if (cb_expr_kind_is_binary(e->kind)) {
-        return cm_binary(c, e);
-    } else if (e->kind == CB_EXPR_LIT) {
-        return cm_literal(c, &e->lit);
+static Val cm_ident(Compiler* c, CB_ExprId e) {
+    // the type pass made sure it was declared
+    u32 i = sy_lookup(&c->syms, c->exprs->data[e].ident);
+    const Symbol* s = sy_get(&c->syms, i);
+    if (s->kind == SY_CONSTANT) {
+        usize id = s->id;
+        return val(id, s->type);
+    }
+
+    usize id = c->id++;
+    char ct = TYPE_TABLE[s->type];
+    CmOp load = ct == 'd' ? CM_OP_LOADD : ct == 'l' ? CM_OP_LOADL : CM_OP_LOADW;
+    cm_emit_unop(c, id, ct, load, s->id);
+    return val(id, s->type);
+}
+
+void cm_forget_values(Compiler* c) {
+    c->gen++;
+}
+
+static void cm_remember_value(Compiler* c, CB_ExprId key, Val v) {
+    if (key >= c->known_cap) {
+        usize cap = c->known_cap ? c->known_cap : 256;
+        while (cap <= key)
+            cap *= 2;
+
+        c->known = realloc(c->known, cap * sizeof(Val));
+        check_alloc(c->known);
+        c->known_gen = realloc(c->known_gen, cap * sizeof(u32));
+        check_alloc(c->known_gen);
+        memset(&c->known_gen[c->known_cap], 0,
+               (cap - c->known_cap) * sizeof(u32));
+        c->known_cap = cap;
+    }
+
+    c->known[key] = v;
+    c->known_gen[key] = c->gen;
+}
+
+Val cm_expr(Compiler* c, CB_ExprId e) {
+    // an equal tree that was already worked out is just used again
+    bool sharing = c->exprs->same && c->gen;
+    CB_ExprId key = cb_expr_same(c->exprs, e);
+    if (sharing && key < c->known_cap && c->known_gen[key] == c->gen)
+        return c->known[key];
+
+    CB_ExprKind k = c->exprs->kinds[e];
+    const CB_Value* folded = cm_folded(c, e);
+    Val v;
+    if (folded) {
+        // nothing under it has to run
+        v = cm_literal(c, folded);
+    } else if (cb_expr_kind_is_unary(k)) {
+        v = cm_unary(c, e);
+    } else if (cb_expr_kind_is_binary(k)) {
+        v = cm_binary(c, e);
+    } else if (k == CB_EXPR_LIT) {
+        v = cm_literal(c, cb_expr_lit(c->exprs, e));
     } else {
-        panic("identifier not implemented");
+        v = cm_ident(c, e);
     }
+
+    if (!cb_expr_kind_is_pure(k))
+        cm_forget_values(c);
+    else if (sharing && v.have)
+        cm_remember_value(c, key, v);
+    return v;
 }
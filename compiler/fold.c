@@ -0,0 +1,253 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdlib.h> // used in macro
+#include <string.h>
+
+#include "../arena.h"
+#include "../ast.h"
+#include "../common.h"
+#include "../symbols.h"
+#include "compiler.h"
+#include "compiler_internal.h"
+
+// the folded values are kept next to the nodes rather than in them: the
+// expressions may be mapped from a cache file, or shared with the parser.
+// a node that was not folded has a value of kind CB_PRIM_NULL.
+
+#define is_numeric(k) ((k) == CB_PRIM_INTEGER || (k) == CB_PRIM_REAL)
+
+static f64 as_real(const CB_Value* v) {
+    return v->kind == CB_PRIM_REAL ? v->real : (f64)v->integer;
+}
+
+// integers wrap around like they do at run time
+static CB_Value fold_integer(CB_ExprKind k, i64 l, i64 r) {
+    u64 a = l, b = r;
+    switch (k) {
+        case CB_EXPR_ADD: return cb_value_new_integer((i64)(a + b));
+        case CB_EXPR_SUB: return cb_value_new_integer((i64)(a - b));
+        case CB_EXPR_MUL: return cb_value_new_integer((i64)(a * b));
+        default: return cb_value_new_null();
+    }
+}
+
+static CB_Value fold_real(CB_ExprKind k, f64 l, f64 r) {
+    f64 res;
+    switch (k) {
+        case CB_EXPR_ADD: res = l + r; break;
+        case CB_EXPR_SUB: res = l - r; break;
+        case CB_EXPR_MUL: res = l * r; break;
+        case CB_EXPR_DIV: res = l / r; break;
+        default: return cb_value_new_null();
+    }
+
+    // there is no literal for these, so they are left for run time
+    if (!isfinite(res))
+        return cb_value_new_null();
+    return cb_value_new_real(res);
+}
+
+static CB_Value fold_compare(CB_ExprKind k, const CB_Value* l,
+                             const CB_Value* r) {
+    if (is_numeric(l->kind) && is_numeric(r->kind)) {
+        // the same promotion as cm_binary
+        bool real = l->kind == CB_PRIM_REAL || r->kind == CB_PRIM_REAL;
+        i64 li = l->integer, ri = r->integer;
+        f64 lr = as_real(l), rr = as_real(r);
+        switch (k) {
+            case CB_EXPR_LT:
+                return cb_value_new_boolean(real ? lr < rr : li < ri);
+            case CB_EXPR_GT:
+                return cb_value_new_boolean(real ? lr > rr : li > ri);
+            case CB_EXPR_LEQ:
+                return cb_value_new_boolean(real ? lr <= rr : li <= ri);
+            case CB_EXPR_GEQ:
+                return cb_value_new_boolean(real ? lr >= rr : li >= ri);
+            case CB_EXPR_EQ:
+                return cb_value_new_boolean(real ? lr == rr : li == ri);
+            case CB_EXPR_NEQ:
+                return cb_value_new_boolean(real ? lr != rr : li != ri);
+            default: return cb_value_new_null();
+        }
+    }
+
+    if (l->kind != r->kind || (k != CB_EXPR_EQ && k != CB_EXPR_NEQ))
+        return cb_value_new_null();
+
+    bool eq;
+    switch (l->kind) {
+        case CB_PRIM_BOOLEAN: eq = l->boolean == r->boolean; break;
+        case CB_PRIM_CHAR: eq = l->chr == r->chr; break;
+        case CB_PRIM_STRING: {
+            eq = l->string.len == r->string.len &&
+                 !memcmp(l->string.data, r->string.data, l->string.len);
+        } break;
+        default: return cb_value_new_null();
+    }
+
+    return cb_value_new_boolean(k == CB_EXPR_EQ ? eq : !eq);
+}
+
+static CB_Value fold_binary(Compiler* c, CB_ExprKind k, const CB_Value* l,
+                            const CB_Value* r) {
+    switch (k) {
+        case CB_EXPR_ADD: {
+            if (l->kind == CB_PRIM_STRING && r->kind == CB_PRIM_STRING) {
+                usize len = l->string.len + r->string.len;
+                char* data = ar_alloc(&c->fold_arena, len + 1);
+                memcpy(data, l->string.data, l->string.len);
+                memcpy(&data[l->string.len], r->string.data, r->string.len);
+                data[len] = '\0';
+                return cb_value_new_arena_string(data, len);
+            }
+        } // fallthrough
+        case CB_EXPR_SUB:
+        case CB_EXPR_MUL:
+        case CB_EXPR_DIV: {
+            if (!is_numeric(l->kind) || !is_numeric(r->kind))
+                break;
+
+            // the same promotion as cm_binary: a real on either side makes
+            // both real, and division is always done on reals
+            if (k != CB_EXPR_DIV && l->kind == CB_PRIM_INTEGER &&
+                r->kind == CB_PRIM_INTEGER)
+                return fold_integer(k, l->integer, r->integer);
+            return fold_real(k, as_real(l), as_real(r));
+        } break;
+        case CB_EXPR_LT:
+        case CB_EXPR_GT:
+        case CB_EXPR_LEQ:
+        case CB_EXPR_GEQ:
+        case CB_EXPR_EQ:
+        case CB_EXPR_NEQ: {
+            return fold_compare(k, l, r);
+        } break;
+        case CB_EXPR_AND:
+        case CB_EXPR_OR: {
+            if (l->kind != CB_PRIM_BOOLEAN || r->kind != CB_PRIM_BOOLEAN)
+                break;
+
+            if (k == CB_EXPR_AND)
+                return cb_value_new_boolean(l->boolean && r->boolean);
+            return cb_value_new_boolean(l->boolean || r->boolean);
+        } break;
+        default: break;
+    }
+
+    // anything else is left for the type pass to report, or for cm_binary
+    return cb_value_new_null();
+}
+
+static CB_Value fold_unary(CB_ExprKind k, const CB_Value* v) {
+    switch (k) {
+        case CB_EXPR_GROUPING: return *v;
+        case CB_EXPR_NEGATION: {
+            if (v->kind == CB_PRIM_INTEGER)
+                return cb_value_new_integer((i64)(0 - (u64)v->integer));
+            if (v->kind == CB_PRIM_REAL)
+                return cb_value_new_real(-v->real);
+        } break;
+        case CB_EXPR_NOT: {
+            if (v->kind == CB_PRIM_BOOLEAN)
+                return cb_value_new_boolean(!v->boolean);
+        } break;
+        case CB_EXPR_BITNOT: {
+            if (v->kind == CB_PRIM_INTEGER)
+                return cb_value_new_integer(~v->integer);
+        } break;
+        default: break;
+    }
+
+    return cb_value_new_null();
+}
+
+static void cm_grow_folds(Compiler* c, CB_ExprId e) {
+    usize cap = c->folds_cap ? c->folds_cap : 256;
+    while (cap <= e)
+        cap *= 2;
+
+    c->folds = realloc(c->folds, cap * sizeof(CB_Value));
+    check_alloc(c->folds);
+    c->folds_gen = realloc(c->folds_gen, cap * sizeof(u32));
+    check_alloc(c->folds_gen);
+    memset(&c->folds_gen[c->folds_cap], 0,
+           (cap - c->folds_cap) * sizeof(u32));
+    c->folds_cap = cap;
+}
+
+static CB_Value cm_fold_expr(Compiler* c, CB_ExprId e) {
+    if (e >= c->folds_cap)
+        cm_grow_folds(c, e);
+    if (c->folds_gen[e] == c->fold_gen)
+        return c->folds[e];
+
+    const CB_Exprs* xs = c->exprs;
+    CB_ExprKind k = xs->kinds[e];
+    CB_Value res = cb_value_new_null();
+
+    if (k == CB_EXPR_LIT) {
+        res = *cb_expr_lit(xs, e);
+    } else if (k == CB_EXPR_IDENT) {
+        // constants whose values are known are used as those values
+        u32 i = sy_lookup(&c->syms, xs->data[e].ident);
+        if (i != SY_NONE && sy_get(&c->syms, i)->kind == SY_CONSTANT)
+            res = sy_get(&c->syms, i)->value;
+    } else if (cb_expr_kind_is_unary(k)) {
+        CB_Value v = cm_fold_expr(c, xs->data[e].unary);
+        if (v.kind != CB_PRIM_NULL)
+            res = fold_unary(k, &v);
+    } else if (cb_expr_kind_is_binary(k)) {
+        // both sides are looked at, so that nothing under them is missed
+        CB_Value l = cm_fold_expr(c, xs->data[e].lhs);
+        CB_Value r = cm_fold_expr(c, xs->data[e].rhs);
+        if (l.kind != CB_PRIM_NULL && r.kind != CB_PRIM_NULL)
+            res = fold_binary(c, k, &l, &r);
+    }
+
+    c->folds[e] = res;
+    c->folds_gen[e] = c->fold_gen;
+    return res;
+}
+
+void cm_fold_stmt(Compiler* c, CB_Stmt* s) {
+    // what was folded for the last statement is dropped, nodes and all
+    c->fold_gen++;
+    ar_reset(&c->fold_arena);
+
+    switch (s->kind) {
+        case CB_STMT_EXPR: {
+            cm_fold_expr(c, s->expr);
+        } break;
+        case CB_STMT_OUTPUT: {
+            for (usize i = 0; i < s->output.len; i++)
+                cm_fold_expr(c, s->output.exprs[i]);
+        } break;
+        case CB_STMT_CONSTANT: {
+            cm_fold_expr(c, s->constant.value);
+        } break;
+        case CB_STMT_ASSIGN: {
+            cm_fold_expr(c, s->assign.value);
+        } break;
+        // the target of an INPUT or an assignment is written to, so it must
+        // stay the place it names, even if that is a known constant
+        default: break;
+    }
+}
+
+const CB_Value* cm_folded(const Compiler* c, CB_ExprId e) {
+    if (!c->fold_gen || e >= c->folds_cap || c->folds_gen[e] != c->fold_gen)
+        return NULL;
+    if (c->folds[e].kind == CB_PRIM_NULL)
+        return NULL;
+    return &c->folds[e];
+}
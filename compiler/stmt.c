@@ -9,35 +9,54 @@
  */
 #define _POSIX_C_SOURCE 200809L
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h> // used in macro
+#include <string.h>
 
 #include "../a_string.h"
+#include "../arena.h"
 #include "../ast.h"
+#include "../atom.h"
 #include "../common.h"
+#include "../symbols.h"
 #include "compiler.h"
 #include "compiler_internal.h"
 
+// printf with one argument after the format
+static void cm_emit_printf(Compiler* c, const char* format, char cls,
+                           usize arg) {
+    CmArg args[] = {
+        cm_arg_global('l', format),
+        CM_ARG_VARARGS,
+        cm_arg_temp(cls, arg),
+    };
+    cm_emit_call(c, "printf", args, 3);
+}
+
 static void cm_output_stmt(Compiler* c, CB_Stmt* s) {
     for (usize i = 0; i < s->output.len; i++) {
-        CB_Expr* e = &s->output.exprs[i];
-        Val v = cm_expr(c, e);
+        Val v = cm_expr(c, s->output.exprs[i]);
+        if (!v.have) // it was already reported
+            continue;
+
         switch (v.kind) {
             case CB_PRIM_STRING: {
-                cm_writefln(c, "call $printf(l $__FS, ..., l %%r%zu)", v.id);
+                cm_emit_printf(c, "__FS", 'l', v.id);
             } break;
             case CB_PRIM_INTEGER: {
-                cm_writefln(c, "call $printf(l $__FI, ..., l %%r%zu)", v.id);
+                cm_emit_printf(c, "__FI", 'l', v.id);
             } break;
             case CB_PRIM_REAL: {
                 // TODO: fix precision bug
-                cm_writefln(c, "call $printf(l $__FR, ..., d %%r%zu)", v.id);
+                cm_emit_printf(c, "__FR", 'd', v.id);
             } break;
             case CB_PRIM_BOOLEAN: {
-                cm_writefln(c, "call $__PRINT_BOOLEAN(w %%r%zu)", v.id);
+                CmArg arg = cm_arg_temp('w', v.id);
+                cm_emit_call(c, "__PRINT_BOOLEAN", &arg, 1);
             } break;
             case CB_PRIM_CHAR: {
-                cm_writefln(c, "call $printf(l $__FC, ..., w %%r%zu)", v.id);
+                cm_emit_printf(c, "__FC", 'w', v.id);
             } break;
             default: {
                 panic("outputting type \"%s\" not implemented",
@@ -51,7 +70,129 @@ static void cm_output_stmt(Compiler* c, CB_Stmt* s) {
         }
     }
 
-    cm_writefln(c, "call $putchar(w 10)\n");
+    CmArg newline = cm_arg_int('w', 10);
+    cm_emit_call(c, "putchar", &newline, 1);
+    cm_write(c, "\n");
+}
+
+// the index of the new symbol, or SY_NONE if the name was taken
+static u32 cm_declare(Compiler* c, Symbol s) {
+    u32 dup;
+    u32 i = sy_declare(&c->syms, s, &dup);
+    if (i == SY_NONE)
+        cm_diag(c, s.pos, "%s was already declared in this scope",
+                at_str(c->atoms, s.name));
+    return i;
+}
+
+static CB_Value zero_value(CB_Type t) {
+    switch (t) {
+        case CB_PRIM_INTEGER: return cb_value_new_integer(0);
+        case CB_PRIM_REAL: return cb_value_new_real(0);
+        case CB_PRIM_BOOLEAN: return cb_value_new_boolean(false);
+        case CB_PRIM_CHAR: return cb_value_new_char('\0');
+        default: return cb_value_new_arena_string((char*)"", 0);
+    }
+}
+
+static void cm_declare_stmt(Compiler* c, CB_Stmt* s) {
+    const CB_DeclareStmt* d = &s->declare;
+    CB_Value zero = zero_value(d->type);
+    char cls = TYPE_TABLE[d->type];
+
+    for (usize i = 0; i < d->len; i++) {
+        u32 sym = cm_declare(c, (Symbol){
+                                    .name = d->names[i],
+                                    .kind = SY_VARIABLE,
+                                    .type = d->type,
+                                    .pos = s->pos,
+                                    .exported = d->exported,
+                                });
+        if (sym == SY_NONE)
+            continue;
+
+        // every variable gets a stack slot, which starts out as zero
+        usize slot = c->id++;
+        cm_emit_alloc(c, slot, 8);
+        Val v = cm_literal(c, &zero);
+        cm_emit_store(c, cls, v.id, slot);
+        sy_get(&c->syms, sym)->id = slot;
+    }
+}
+
+// the text of a string constant has to outlive the statement it was folded in
+static CB_Value cm_keep_value(Compiler* c, CB_Value v) {
+    if (v.kind != CB_PRIM_STRING)
+        return v;
+
+    char* data = ar_alloc(&c->const_arena, v.string.len + 1);
+    memcpy(data, v.string.data, v.string.len);
+    data[v.string.len] = '\0';
+    return cb_value_new_arena_string(data, v.string.len);
+}
+
+static void cm_constant_stmt(Compiler* c, CB_Stmt* s) {
+    const CB_ConstantStmt* k = &s->constant;
+    Symbol sym = {
+        .name = k->name,
+        .kind = SY_CONSTANT,
+        .type = cm_type_of(c, k->value).type,
+        .pos = s->pos,
+        .exported = k->exported,
+    };
+
+    // a value known now is used as it is wherever the constant is, and
+    // anything else is worked out once, here
+    const CB_Value* folded = cm_folded(c, k->value);
+    if (folded)
+        sym.value = cm_keep_value(c, *folded);
+    else
+        sym.id = cm_expr(c, k->value).id;
+
+    cm_declare(c, sym);
+}
+
+static void cm_assign_stmt(Compiler* c, CB_Stmt* s) {
+    const CB_AssignStmt* a = &s->assign;
+    u32 i = sy_lookup(&c->syms, c->exprs->data[a->target].ident);
+    CB_Type type = sy_get(&c->syms, i)->type;
+    usize slot = sy_get(&c->syms, i)->id;
+
+    Val v = cm_expr(c, a->value);
+    if (!v.have)
+        return;
+    if (type == CB_PRIM_REAL && v.kind == CB_PRIM_INTEGER)
+        v = cm_to_real(c, v);
+
+    cm_emit_store(c, TYPE_TABLE[type], v.id, slot);
+}
+
+static void cm_enter_scope(Compiler* c, CB_Stmt* s) {
+    if (!sy_depth(&c->syms))
+        c->scope_pos = s->pos;
+    sy_enter(&c->syms);
+}
+
+static void cm_leave_scope(Compiler* c, CB_Stmt* s) {
+    SymbolTable* t = &c->syms;
+    if (!sy_depth(t)) {
+        cm_diag(c, s->pos, "ENDSCOPE without a SCOPE to end");
+        return;
+    }
+
+    // what was exported is declared again in the enclosing scope, with the
+    // same register and value
+    Symbols exported = {0};
+    for (usize i = sy_scope_start(t); i < t->symbols.len; i++)
+        if (sy_get(t, i)->exported)
+            av_append(&exported, *sy_get(t, i));
+
+    sy_leave(t);
+    for (usize i = 0; i < exported.len; i++) {
+        exported.data[i].exported = false;
+        cm_declare(c, exported.data[i]);
+    }
+    av_free(&exported);
 }
 
 void cm_stmt(Compiler* c, CB_Stmt* s) {
@@ -59,6 +200,21 @@ void cm_stmt(Compiler* c, CB_Stmt* s) {
         case CB_STMT_OUTPUT: {
             cm_output_stmt(c, s);
         } break;
+        case CB_STMT_DECLARE: {
+            cm_declare_stmt(c, s);
+        } break;
+        case CB_STMT_CONSTANT: {
+            cm_constant_stmt(c, s);
+        } break;
+        case CB_STMT_ASSIGN: {
+            cm_assign_stmt(c, s);
+        } break;
+        case CB_STMT_SCOPE: {
+            cm_enter_scope(c, s);
+        } break;
+        case CB_STMT_ENDSCOPE: {
+            cm_leave_scope(c, s);
+        } break;
         default: panic("statement %d not implemented", s->kind);
     }
 }
@@ -88,22 +244,52 @@ static void write_format_specifiers(Compiler* c) {
 }
 
 #define MAX_ERROR_COUNT 20
-bool cm_program(Compiler* c, CB_Program* prog, a_string* file_name) {
+void cm_program_begin(Compiler* c, const CB_Exprs* exprs,
+                      const AtomTable* atoms, a_string* file_name,
+                      LineIndex* lines) {
+    c->exprs = exprs;
+    c->atoms = atoms;
+    c->syms = sy_new();
     if (file_name)
         c->file_name = *file_name;
+    c->lines = lines;
 
     write_utils(c);
     cm_writeln(c, "export function w $main() {\n@start");
-    for (usize i = 0; i < prog->len; i++) {
-        cm_stmt(c, &prog->stmts[i]);
+}
 
-        if (c->error_count > MAX_ERROR_COUNT) {
-            cm_diag(c, prog->stmts[i].pos,
-                    "too many errors reported, stopping now.");
-            return false;
-        }
+bool cm_program_stmt(Compiler* c, CB_Stmt* s) {
+    // a statement can change variables, and will be able to start a block
+    cm_forget_values(c);
+    // a statement with type errors is not compiled at all
+    // folded first, so that what is folded away does not have to be
+    // something cm_stmt can do
+    cm_fold_stmt(c, s);
+    if (cm_check_stmt(c, s)) {
+        cm_stmt(c, s);
+    } else if (s->kind == CB_STMT_CONSTANT) {
+        // still declared, without a type, so that using it is not reported
+        // as well
+        cm_declare(c, (Symbol){
+                          .name = s->constant.name,
+                          .kind = SY_CONSTANT,
+                          .pos = s->pos,
+                          .exported = s->constant.exported,
+                      });
+    }
+
+    if (c->error_count > MAX_ERROR_COUNT) {
+        cm_diag(c, s->pos, "too many errors reported, stopping now.");
+        return false;
     }
 
+    return true;
+}
+
+bool cm_program_end(Compiler* c) {
+    if (sy_depth(&c->syms))
+        cm_diag(c, c->scope_pos, "SCOPE was never ended with ENDSCOPE");
+
     if (c->error_count) {
         cm_diag(c, BEGIN_POS, "errors were reported.");
         return false;
@@ -112,13 +298,29 @@ bool cm_program(Compiler* c, CB_Program* prog, a_string* file_name) {
     cm_writeln(c, "ret 0\n}");
 
     for (usize i = 0; i < c->ss.len; i++) {
-        cm_writef(c, "data $__S%zu = align 1 { b \"", i);
-        // TODO: escape sequences
-        cm_writef(c, "%.*s", as_fmt(c->ss.data[i]));
-        cm_writeln(c, "\", b 0 }\n");
+        const a_string* str = &c->ss.data[i];
+        // the string stops at a null byte, as it does when it is printed
+        cm_emit_data_string(c, i, str->data, strnlen(str->data, str->len));
     }
 
     write_format_specifiers(c);
 
+    if (!cm_commit(c)) {
+        cm_diag(c, BEGIN_POS, "could not write the output: %s",
+                strerror(errno));
+        return false;
+    }
+
     return true;
 }
+
+bool cm_program(Compiler* c, CB_Program* prog, a_string* file_name,
+                LineIndex* lines) {
+    cm_program_begin(c, &prog->exprs, prog->atoms, file_name, lines);
+    for (usize i = 0; i < prog->len; i++) {
+        if (!cm_program_stmt(c, &prog->stmts[i]))
+            return false;
+    }
+
+    return cm_program_end(c);
+}
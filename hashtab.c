@@ -0,0 +1,81 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "hashtab.h"
+
+HashTable ht_new(u32 cap) {
+    HashTable res = {
+        .slots = calloc(cap, sizeof(u64)),
+        .cap = cap,
+    };
+    check_alloc(res.slots);
+    return res;
+}
+
+void ht_free(HashTable* t) {
+    free(t->slots);
+    *t = (HashTable){0};
+}
+
+void ht_clear(HashTable* t) {
+    memset(t->slots, 0, t->cap * sizeof(u64));
+    t->len = 0;
+}
+
+static void ht_grow(HashTable* t) {
+    u32 cap = t->cap * 2;
+    u64* slots = calloc(cap, sizeof(u64));
+    check_alloc(slots);
+
+    // the hashes are kept in the slots, so nothing is hashed again
+    for (u32 j = 0; j < t->cap; j++) {
+        if (!t->slots[j])
+            continue;
+
+        u32 i = (t->slots[j] >> 32) & (cap - 1);
+        while (slots[i])
+            i = (i + 1) & (cap - 1);
+        slots[i] = t->slots[j];
+    }
+
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+}
+
+void ht_insert(HashTable* t, u32 i, u32 hash, u32 id) {
+    t->slots[i] = (u64)hash << 32 | (id + 1);
+
+    // keep the load factor under 1/2
+    if (++t->len * 2 > t->cap)
+        ht_grow(t);
+}
+
+void ht_remove(HashTable* t, u32 i) {
+    u32 mask = t->cap - 1;
+    t->slots[i] = 0;
+    t->len--;
+
+    // shifts back whatever would not be found past the hole otherwise
+    for (u32 j = (i + 1) & mask; t->slots[j]; j = (j + 1) & mask) {
+        u32 home = (t->slots[j] >> 32) & mask;
+        bool reachable = i <= j ? (i < home && home <= j)
+                                : (i < home || home <= j);
+        if (reachable)
+            continue;
+
+        t->slots[i] = t->slots[j];
+        t->slots[j] = 0;
+        i = j;
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _HASHTAB_H
+#define _HASHTAB_H
+
+#include <stdbool.h>
+
+#include "common.h"
+
+// a set of u32 ids, found by hash with linear probing, for tables whose keys
+// live somewhere else. each slot keeps the id along with its hash, so that
+// only ids with the same hash are ever compared, and growing never hashes
+// anything again. it never gets more than half full.
+//
+// a lookup starts at ht_start, and steps with ht_next until it finds its id
+// or reaches an empty slot, which is where the id would be inserted:
+//
+//   u32 i = ht_start(t, hash);
+//   for (; !ht_empty(t, i); i = ht_next(t, i))
+//       if (ht_hash(t, i) == hash && equal(ht_id(t, i), key))
+//           return ht_id(t, i);
+//   ht_insert(t, i, hash, new_id);
+//
+// not thread-safe: a table may only be used by one thread at a time.
+typedef struct {
+    u64* slots; // hash << 32 | (id + 1), or 0 if empty
+    u32 cap;    // always a power of two
+    u32 len;    // slots in use
+} HashTable;
+
+// cap must be a power of two
+HashTable ht_new(u32 cap);
+void ht_free(HashTable* t);
+// empties the table, keeping its size
+void ht_clear(HashTable* t);
+
+#define ht_start(t, hash) ((hash) & ((t)->cap - 1))
+#define ht_next(t, i)     (((i) + 1) & ((t)->cap - 1))
+#define ht_empty(t, i)    (!(t)->slots[(i)])
+#define ht_hash(t, i)     ((u32)((t)->slots[(i)] >> 32))
+#define ht_id(t, i)       ((u32)(t)->slots[(i)] - 1)
+
+// puts id in the empty slot i, where a lookup for hash stopped. the table may
+// grow, which moves everything, so any other slot index is no good after it.
+void ht_insert(HashTable* t, u32 i, u32 hash, u32 id);
+// takes the id in slot i out. other slot indices are no good after it either.
+void ht_remove(HashTable* t, u32 i);
+
+#endif // _HASHTAB_H
@@ -10,32 +10,33 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <ctype.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <unistd.h>
 
-#include "3rdparty/uthash.h"
 #include "a_string.h"
+#include "atom.h"
 #include "common.h"
 #include "lexer.h"
 #include "lexer_types.h"
+#include "scan.h"
 
 #define CUR  (l->src[l->cur])
 #define PEEK (l->src[l->cur + 1])
-#define BUMP_NEWLINE                                                           \
-    do {                                                                       \
-        l->row++;                                                              \
-        l->bol = ++l->cur;                                                     \
-    } while (0)
 #define IN_BOUNDS (l->cur < l->src_len)
+// for something of length sp that was just scanned past
 #define POS(sp)                                                                \
     (Pos) {                                                                    \
-        .row = l->row, .col = l->cur - l->bol + 1 - (sp), .span = (sp)         \
+        .offset = l->cur - (sp), .span = (sp)                                  \
     }
 
 #define POS_HERE(sp)                                                           \
     (Pos) {                                                                    \
-        .row = l->row, .col = l->cur - l->bol + 1, .span = (sp)                \
+        .offset = l->cur, .span = (sp)                                         \
     }
 
 #define TOKEN(kfull, sp)                                                       \
@@ -62,17 +63,10 @@
         }                                                                      \
     } while (0)
 
-#define TRY_AND_FREE(expr)                                                     \
-    do {                                                                       \
-        if ((expr)) {                                                          \
-            goto next_token_error;                                             \
-        } else if (l->error.kind != LX_ERROR_NULL) {                           \
-            as_free(&word);                                                    \
-            return NULL;                                                       \
-        }                                                                      \
-    } while (0)
+// pointer to the first character of a word slice
+#define WORD(w) (&l->src[(w)->offset])
 
-static const char* TOKEN_STRINGS[] = {
+static const char* const TOKEN_STRINGS[] = {
     [TOK_IDENT] = "ident",
     [TOK_EOF] = "eof",
     [TOK_INVALID] = "invalid",
@@ -118,6 +112,8 @@ static const char* TOKEN_STRINGS[] = {
     [TOK_UNTIL] = "UNTIL",
     [TOK_STRUCT] = "STRUCT",
     [TOK_ENDSTRUCT] = "ENDSTRUCT",
+    [TOK_SCOPE] = "SCOPE",
+    [TOK_ENDSCOPE] = "ENDSCOPE",
     [TOK_INTEGER] = "INTEGER",
     [TOK_REAL] = "REAL",
     [TOK_BOOLEAN] = "BOOLEAN",
@@ -154,59 +150,35 @@ static const char* TOKEN_STRINGS[] = {
     [TOK_BITXOR] = "bitxor",
 };
 
-Token token_new_ident(const char* str) {
-    a_string s = astr(str);
-    return (Token){
-        .kind = TOK_IDENT,
-        .data.string = s,
-    };
-}
-
-void token_free(Token* t) {
-    if (t->kind == TOK_IDENT || t->kind == TOK_LITERAL_STRING ||
-        t->kind == TOK_LITERAL_CHAR || t->kind == TOK_LITERAL_NUMBER) {
-        as_free(&t->data.string);
-    }
-}
-
-Token token_dupe(Token* t) {
-    Token new = {
-        .kind = t->kind,
-        .pos = t->pos,
-    };
-    if (t->kind == TOK_IDENT || t->kind == TOK_LITERAL_STRING ||
-        t->kind == TOK_LITERAL_CHAR || t->kind == TOK_LITERAL_NUMBER) {
-        new.data.string = as_dupe(&t->data.string);
-    } else if (t->kind == TOK_LITERAL_BOOLEAN) {
-        new.data.boolean = t->data.boolean;
-    }
-
-    return new;
+a_string token_to_string(const Token* t, const char* src) {
+    return as_slice_cstr(src, t->data.slice.offset,
+                         t->data.slice.offset + t->data.slice.len);
 }
 
 const char* token_kind_string(TokenKind k) {
-    if ((i32)k < 0 || (i32)k > LENGTH(TOKEN_STRINGS))
+    if ((i32)k < 0 || (i32)k >= LENGTH(TOKEN_STRINGS))
         panic("invalid token kind");
 
     return TOKEN_STRINGS[k];
 }
 
-void token_print_long(Token* t) {
-    eprintf("token[%d, %d, %d]: ", t->pos.row, t->pos.col, t->pos.span);
+void token_print_long(Token* t, const char* src) {
+    eprintf("token[%u, %u]: ", t->pos.offset, t->pos.span);
 
-    const a_string* s = &t->data.string;
+    int len = (int)t->data.slice.len;
+    const char* s = &src[t->data.slice.offset];
     switch (t->kind) {
         case TOK_IDENT: {
-            eprintf("(%.*s)", as_fmtp(s));
+            eprintf("(%.*s)", len, s);
         } break;
         case TOK_LITERAL_STRING: {
-            eprintf("\"%.*s\"", as_fmtp(s));
+            eprintf("\"%.*s\"", len, s);
         } break;
         case TOK_LITERAL_CHAR: {
-            eprintf("'%.*s'", as_fmtp(s));
+            eprintf("'%.*s'", len, s);
         } break;
         case TOK_LITERAL_NUMBER: {
-            eprintf("%.*s", as_fmtp(s));
+            eprintf("%.*s", len, s);
         } break;
         case TOK_LITERAL_BOOLEAN: {
             if (t->data.boolean) {
@@ -227,117 +199,243 @@ void token_print(Token* t) {
 }
 
 // lexer stuff
-#define LX_KWT_STRSZ 64
+
+// maps every byte to its uppercase form, so that keywords can be folded
+// without touching the word.
+#define FOLD(c)    ((c) >= 'a' && (c) <= 'z' ? (c) - 32 : (c))
+#define FOLD4(c)   FOLD(c), FOLD(c + 1), FOLD(c + 2), FOLD(c + 3)
+#define FOLD16(c)  FOLD4(c), FOLD4(c + 4), FOLD4(c + 8), FOLD4(c + 12)
+#define FOLD64(c)  FOLD16(c), FOLD16(c + 16), FOLD16(c + 32), FOLD16(c + 48)
+static const u8 LX_FOLD[256] = {
+    FOLD64(0),
+    FOLD64(64),
+    FOLD64(128),
+    FOLD64(192),
+};
+
+#define LX_KWT_SIZE   128
+#define LX_KWT_MAXLEN 12
+
+// perfect hash over the length and the first, second to last and last
+// (uppercase) characters of a keyword. the coefficients were searched for so
+// that no two keywords collide; a collision shows up as an overridden
+// initializer warning.
+#define LX_KWT_HASH(len, c0, cp, cl)                                           \
+    (((len) * 8 + (c0) * 8 + (cp) * 5 + (cl) * 2) & (LX_KWT_SIZE - 1))
 
 typedef struct {
-    char txt[LX_KWT_STRSZ];
+    char txt[LX_KWT_MAXLEN + 1]; // uppercase
+    u8 len;
     TokenKind kw;
-    UT_hash_handle hh;
-} KeywordTable;
-
-KeywordTable* kwt;
-
-static void lx_kwt_setup(void);
-static void lx_kwt_add(const char* s, TokenKind k);
-static TokenKind lx_kwt_get(const char* s);
-static void lx_kwt_free(void);
-
-static void lx_kwt_setup(void) {
-    kwt = NULL;
-
-    lx_kwt_add("declare", TOK_DECLARE);
-    lx_kwt_add("constant", TOK_CONSTANT);
-    lx_kwt_add("output", TOK_OUTPUT);
-    lx_kwt_add("print", TOK_PRINT);
-    lx_kwt_add("input", TOK_INPUT);
-    lx_kwt_add("and", TOK_AND);
-    lx_kwt_add("or", TOK_OR);
-    lx_kwt_add("not", TOK_NOT);
-    lx_kwt_add("if", TOK_IF);
-    lx_kwt_add("then", TOK_THEN);
-    lx_kwt_add("else", TOK_ELSE);
-    lx_kwt_add("endif", TOK_ENDIF);
-    lx_kwt_add("case", TOK_CASE);
-    lx_kwt_add("of", TOK_OF);
-    lx_kwt_add("otherwise", TOK_OTHERWISE);
-    lx_kwt_add("endcase", TOK_ENDCASE);
-    lx_kwt_add("while", TOK_WHILE);
-    lx_kwt_add("do", TOK_DO);
-    lx_kwt_add("endwhile", TOK_ENDWHILE);
-    lx_kwt_add("for", TOK_FOR);
-    lx_kwt_add("to", TOK_TO);
-    lx_kwt_add("step", TOK_STEP);
-    lx_kwt_add("next", TOK_NEXT);
-    lx_kwt_add("function", TOK_FUNCTION);
-    lx_kwt_add("returns", TOK_RETURNS);
-    lx_kwt_add("endfunction", TOK_ENDFUNCTION);
-    lx_kwt_add("procedure", TOK_PROCEDURE);
-    lx_kwt_add("endprocedure", TOK_ENDPROCEDURE);
-    lx_kwt_add("return", TOK_RETURN);
-    lx_kwt_add("include", TOK_INCLUDE);
-    lx_kwt_add("export", TOK_EXPORT);
-    lx_kwt_add("break", TOK_BREAK);
-    lx_kwt_add("continue", TOK_CONTINUE);
-    lx_kwt_add("repeat", TOK_REPEAT);
-    lx_kwt_add("until", TOK_UNTIL);
-    lx_kwt_add("struct", TOK_STRUCT);
-    lx_kwt_add("endstruct", TOK_ENDSTRUCT);
-    lx_kwt_add("integer", TOK_INTEGER);
-    lx_kwt_add("real", TOK_REAL);
-    lx_kwt_add("boolean", TOK_BOOLEAN);
-    lx_kwt_add("string", TOK_STRING);
-    lx_kwt_add("char", TOK_CHAR);
-    lx_kwt_add("null", TOK_NULL);
-}
-
-static void lx_kwt_add(const char* s, TokenKind k) {
-    KeywordTable* row = malloc(sizeof(KeywordTable));
-    check_alloc(row);
-    strncpy(row->txt, s, LX_KWT_STRSZ - 1);
-    row->kw = k;
-    HASH_ADD_STR(kwt, txt, row);
-}
-
-static TokenKind lx_kwt_get(const char* s) {
-    KeywordTable* out;
-    HASH_FIND_STR(kwt, s, out);
-    if (out)
-        return out->kw;
-    else
+} Keyword;
+
+#define KW(name, c0, cp, cl)                                                   \
+    [LX_KWT_HASH(sizeof(#name) - 1, c0, cp, cl)] = {                           \
+        #name, sizeof(#name) - 1, TOK_##name}
+
+static const Keyword KEYWORDS[LX_KWT_SIZE] = {
+    KW(DECLARE, 'D', 'R', 'E'),
+    KW(CONSTANT, 'C', 'N', 'T'),
+    KW(OUTPUT, 'O', 'U', 'T'),
+    KW(PRINT, 'P', 'N', 'T'),
+    KW(INPUT, 'I', 'U', 'T'),
+    KW(AND, 'A', 'N', 'D'),
+    KW(OR, 'O', 'O', 'R'),
+    KW(NOT, 'N', 'O', 'T'),
+    KW(IF, 'I', 'I', 'F'),
+    KW(THEN, 'T', 'E', 'N'),
+    KW(ELSE, 'E', 'S', 'E'),
+    KW(ENDIF, 'E', 'I', 'F'),
+    KW(CASE, 'C', 'S', 'E'),
+    KW(OF, 'O', 'O', 'F'),
+    KW(OTHERWISE, 'O', 'S', 'E'),
+    KW(ENDCASE, 'E', 'S', 'E'),
+    KW(WHILE, 'W', 'L', 'E'),
+    KW(DO, 'D', 'D', 'O'),
+    KW(ENDWHILE, 'E', 'L', 'E'),
+    KW(FOR, 'F', 'O', 'R'),
+    KW(TO, 'T', 'T', 'O'),
+    KW(STEP, 'S', 'E', 'P'),
+    KW(NEXT, 'N', 'X', 'T'),
+    KW(FUNCTION, 'F', 'O', 'N'),
+    KW(RETURNS, 'R', 'N', 'S'),
+    KW(ENDFUNCTION, 'E', 'O', 'N'),
+    KW(PROCEDURE, 'P', 'R', 'E'),
+    KW(ENDPROCEDURE, 'E', 'R', 'E'),
+    KW(RETURN, 'R', 'R', 'N'),
+    KW(INCLUDE, 'I', 'D', 'E'),
+    KW(EXPORT, 'E', 'R', 'T'),
+    KW(BREAK, 'B', 'A', 'K'),
+    KW(CONTINUE, 'C', 'U', 'E'),
+    KW(REPEAT, 'R', 'A', 'T'),
+    KW(UNTIL, 'U', 'I', 'L'),
+    KW(STRUCT, 'S', 'C', 'T'),
+    KW(ENDSTRUCT, 'E', 'C', 'T'),
+    KW(SCOPE, 'S', 'P', 'E'),
+    KW(ENDSCOPE, 'E', 'P', 'E'),
+    KW(INTEGER, 'I', 'E', 'R'),
+    KW(REAL, 'R', 'A', 'L'),
+    KW(BOOLEAN, 'B', 'A', 'N'),
+    KW(STRING, 'S', 'N', 'G'),
+    KW(CHAR, 'C', 'A', 'R'),
+    KW(NULL, 'N', 'L', 'L'),
+};
+
+#undef KW
+
+static TokenKind lx_kwt_get(const char* s, u32 len) {
+    if (len < 2 || len > LX_KWT_MAXLEN)
         return TOK_INVALID;
-}
 
-static void lx_kwt_free(void) {
-    KeywordTable *elem, *tmp;
+    const u8* w = (const u8*)s;
+    const Keyword* k = &KEYWORDS[LX_KWT_HASH(
+        len, LX_FOLD[w[0]], LX_FOLD[w[len - 2]], LX_FOLD[w[len - 1]])];
+    if (k->len != len)
+        return TOK_INVALID;
 
-    HASH_ITER(hh, kwt, elem, tmp) {
-        HASH_DEL(kwt, elem);
-        free(elem);
+    for (u32 i = 0; i < len; i++) {
+        if (LX_FOLD[w[i]] != (u8)k->txt[i])
+            return TOK_INVALID;
     }
+
+    return k->kw;
 }
 
-static void lx_trim_spaces(Lexer* l);
-static void lx_trim_comment(Lexer* l);
-static bool lx_is_separator(char ch);
-static bool lx_is_operator_start(char ch);
+// every byte falls into one of these classes, and the lexer only ever looks at
+// the class. the order matters: everything from CC_DOT on is a symbol.
+typedef enum {
+    CC_OTHER = 0, // only valid inside an invalid word
+    CC_ALPHA,     // letters and underscores
+    CC_DIGIT,
+    CC_BACKSLASH,
+    CC_BLANK,
+    CC_NEWLINE,
+    CC_QUOTE,
+    CC_DOT,
+    CC_SEP,
+    CC_OP, // an operator that never starts or ends a double symbol
+    CC_LT,
+    CC_GT,
+    CC_MINUS,
+    CC_EQ,
+    CC_TILDE,
+    CC_CARET,
+    CC_COUNT,
+} CharClass;
+
+#define CLASS(c)                                                               \
+    ((c) == '_' || ((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z')    \
+         ? CC_ALPHA                                                            \
+     : (c) >= '0' && (c) <= '9' ? CC_DIGIT                                     \
+     : (c) == '\\'              ? CC_BACKSLASH                                 \
+     : (c) == ' ' || (c) == '\t' || (c) == '\v' || (c) == '\f' || (c) == '\r'  \
+         ? CC_BLANK                                                            \
+     : (c) == '\n'             ? CC_NEWLINE                                    \
+     : (c) == '"' || (c) == '\'' ? CC_QUOTE                                    \
+     : (c) == '.'              ? CC_DOT                                        \
+     : (c) == '{' || (c) == '}' || (c) == '[' || (c) == ']' || (c) == '(' ||   \
+             (c) == ')' || (c) == ';' || (c) == ':' || (c) == ','              \
+         ? CC_SEP                                                              \
+     : (c) == '<' ? CC_LT                                                      \
+     : (c) == '>' ? CC_GT                                                      \
+     : (c) == '-' ? CC_MINUS                                                   \
+     : (c) == '=' ? CC_EQ                                                      \
+     : (c) == '~' ? CC_TILDE                                                   \
+     : (c) == '^' ? CC_CARET                                                   \
+     : (c) == '+' || (c) == '*' || (c) == '/' || (c) == '&' || (c) == '|'      \
+         ? CC_OP                                                               \
+         : CC_OTHER)
+#define CLASS4(c)  CLASS(c), CLASS(c + 1), CLASS(c + 2), CLASS(c + 3)
+#define CLASS16(c) CLASS4(c), CLASS4(c + 4), CLASS4(c + 8), CLASS4(c + 12)
+#define CLASS64(c) CLASS16(c), CLASS16(c + 16), CLASS16(c + 32), CLASS16(c + 48)
+static const u8 LX_CLASS[256] = {
+    CLASS64(0),
+    CLASS64(64),
+    CLASS64(128),
+    CLASS64(192),
+};
 
-static bool lx_next_double_symbol(Lexer* l); // true if found
-static bool lx_next_single_symbol(Lexer* l); // true if found
-static bool lx_next_word(Lexer* l, a_string* res);
-static bool lx_next_keyword(Lexer* l, const a_string* word);
-static bool lx_next_literal(Lexer* l, const a_string* word);
+#define CLASS_OF(ch) (LX_CLASS[(u8)(ch)])
 
-static bool lx_is_separator(char ch) {
-    return strchr("{}[]();:,.", ch);
-}
+static const TokenKind LX_SYMBOLS[256] = {
+    ['{'] = TOK_LCURLY,   ['}'] = TOK_RCURLY, ['['] = TOK_LBRACKET,
+    [']'] = TOK_RBRACKET, ['('] = TOK_LPAREN, [')'] = TOK_RPAREN,
+    [':'] = TOK_COLON,    [','] = TOK_COMMA,  [';'] = TOK_SEMICOLON,
+    ['<'] = TOK_LT,       ['>'] = TOK_GT,     ['='] = TOK_EQ,
+    ['*'] = TOK_MUL,      ['/'] = TOK_DIV,    ['+'] = TOK_ADD,
+    ['-'] = TOK_SUB,      ['^'] = TOK_CARET,  ['&'] = TOK_BITAND,
+    ['|'] = TOK_BITOR,    ['.'] = TOK_DOT,    ['~'] = TOK_BITNOT,
+};
 
-static bool lx_is_operator_start(char ch) {
-    return strchr("+-*/=<>&|^~", ch);
-}
+// indexed by the classes of the first and second character
+static const TokenKind LX_DOUBLE_SYMBOLS[CC_COUNT][CC_COUNT] = {
+    [CC_LT] = {[CC_MINUS] = TOK_ASSIGN, [CC_EQ] = TOK_LEQ, [CC_GT] = TOK_NEQ,
+               [CC_LT] = TOK_SHL},
+    [CC_GT] = {[CC_EQ] = TOK_GEQ, [CC_GT] = TOK_SHR},
+    [CC_TILDE] = {[CC_CARET] = TOK_BITXOR},
+};
 
-Lexer lx_new(const char* src, usize src_len) {
-    lx_kwt_setup();
-    Lexer res = {.src = src, .src_len = src_len, .row = 1};
+// states of the DFA that scans words (anything that is not a symbol or a
+// delimited literal). words end at a space, a quote, an operator or a
+// separator, except that numbers keep their decimal point. a backslash takes
+// the next byte along with it, whatever it is.
+typedef enum {
+    WS_END = 0, // the word ends before this byte
+    WS_START,
+    WS_IDENT,
+    WS_INTEGER,
+    WS_REAL,
+    WS_INVALID,
+    WS_INVALID_NUM,
+    WS_ESCAPE,
+    WS_ESCAPE_NUM,
+    WS_COUNT,
+} WordState;
+
+#define EVERY_CLASS(s)                                                         \
+    {                                                                          \
+        [CC_OTHER] = (s), [CC_ALPHA] = (s), [CC_DIGIT] = (s),                  \
+        [CC_BACKSLASH] = (s), [CC_BLANK] = (s), [CC_NEWLINE] = (s),            \
+        [CC_QUOTE] = (s), [CC_DOT] = (s), [CC_SEP] = (s), [CC_OP] = (s),       \
+        [CC_LT] = (s), [CC_GT] = (s), [CC_MINUS] = (s), [CC_EQ] = (s),         \
+        [CC_TILDE] = (s), [CC_CARET] = (s),                                    \
+    }
+
+static const u8 LX_WORD_DFA[WS_COUNT][CC_COUNT] = {
+    [WS_START] = {[CC_ALPHA] = WS_IDENT, [CC_DIGIT] = WS_INTEGER,
+                  [CC_OTHER] = WS_INVALID, [CC_BACKSLASH] = WS_ESCAPE},
+    [WS_IDENT] = {[CC_ALPHA] = WS_IDENT, [CC_DIGIT] = WS_IDENT,
+                  [CC_OTHER] = WS_INVALID, [CC_BACKSLASH] = WS_ESCAPE},
+    [WS_INTEGER] = {[CC_DIGIT] = WS_INTEGER, [CC_DOT] = WS_REAL,
+                    [CC_ALPHA] = WS_INVALID_NUM, [CC_OTHER] = WS_INVALID_NUM,
+                    [CC_BACKSLASH] = WS_ESCAPE_NUM},
+    [WS_REAL] = {[CC_DIGIT] = WS_REAL, [CC_DOT] = WS_INVALID_NUM,
+                 [CC_ALPHA] = WS_INVALID_NUM, [CC_OTHER] = WS_INVALID_NUM,
+                 [CC_BACKSLASH] = WS_ESCAPE_NUM},
+    [WS_INVALID] = {[CC_ALPHA] = WS_INVALID, [CC_DIGIT] = WS_INVALID,
+                    [CC_OTHER] = WS_INVALID, [CC_BACKSLASH] = WS_ESCAPE},
+    [WS_INVALID_NUM] = {[CC_ALPHA] = WS_INVALID_NUM,
+                        [CC_DIGIT] = WS_INVALID_NUM,
+                        [CC_DOT] = WS_INVALID_NUM,
+                        [CC_OTHER] = WS_INVALID_NUM,
+                        [CC_BACKSLASH] = WS_ESCAPE_NUM},
+    [WS_ESCAPE] = EVERY_CLASS(WS_INVALID),
+    [WS_ESCAPE_NUM] = EVERY_CLASS(WS_INVALID_NUM),
+};
+
+#undef EVERY_CLASS
+
+static void lx_trim_spaces(Lexer* l);
+static void lx_trim_comment(Lexer* l);
+
+static void lx_next_symbol(Lexer* l, CharClass first);
+static bool lx_next_delimited(Lexer* l);
+static WordState lx_next_word(Lexer* l, Slice* res);
+static bool lx_next_keyword(Lexer* l, const Slice* word);
+static bool lx_next_boolean(Lexer* l, const Slice* word);
+
+Lexer lx_new(const char* src, usize src_len, AtomTable* atoms) {
+    Lexer res = {.src = src, .src_len = src_len, .atoms = atoms};
     return res;
 }
 
@@ -346,338 +444,582 @@ static void lx_trim_spaces(Lexer* l) {
         return;
     }
 
-    while (l->cur < l->src_len && isspace(CUR) && CUR != '\n')
-        l->cur++;
+    l->cur += scan_blanks(&CUR, l->src_len - l->cur);
 
     lx_trim_comment(l);
     return;
 }
 
 static void lx_trim_comment(Lexer* l) {
-    if (l->cur + 2 >= l->src_len) {
+    if (l->cur + 2 >= l->src_len || CUR != '/') {
         return;
     }
 
-    if (!strncmp(&CUR, "//", 2)) {
+    if (PEEK == '/') {
         l->cur += 2; // skip past comment marker
 
-        while (IN_BOUNDS && CUR != '\n')
-            l->cur++;
+        const char* nl = memchr(&CUR, '\n', l->src_len - l->cur);
+        l->cur = nl ? (u32)(nl - l->src) : l->src_len;
 
         lx_trim_spaces(l);
         return;
     }
 
-    if (!strncmp(&CUR, "/*", 2)) {
+    if (PEEK == '*') {
         l->cur += 2; // skip past
 
-        while (IN_BOUNDS && strncmp(&CUR, "*/", 2)) {
-            if (CUR == '\n')
-                BUMP_NEWLINE;
-            else
-                l->cur++;
-        }
+        usize end = scan_comment_end(&CUR, l->src_len - l->cur);
 
         // we found */
-        l->cur += 2;
+        l->cur += end + 2;
 
         lx_trim_spaces(l);
         return;
     }
 }
 
-static bool lx_next_double_symbol(Lexer* l) {
-    if (!lx_is_operator_start(CUR))
-        return false;
+static void lx_next_symbol(Lexer* l, CharClass first) {
+    TokenKind t = TOK_INVALID;
+    u16 span = 1;
 
-    if (l->cur + 1 >= l->src_len) {
-        return false;
-    }
+    if (l->cur + 1 < l->src_len)
+        t = LX_DOUBLE_SYMBOLS[first][CLASS_OF(PEEK)];
 
-    if (!strncmp(&CUR, "<-", 2)) {
-        l->token = TOK(ASSIGN, 2);
-    } else if (!strncmp(&CUR, ">=", 2)) {
-        l->token = TOK(GEQ, 2);
-    } else if (!strncmp(&CUR, "<=", 2)) {
-        l->token = TOK(LEQ, 2);
-    } else if (!strncmp(&CUR, "<>", 2)) {
-        l->token = TOK(NEQ, 2);
-    } else if (!strncmp(&CUR, ">>", 2)) {
-        l->token = TOK(SHR, 2);
-    } else if (!strncmp(&CUR, "<<", 2)) {
-        l->token = TOK(SHL, 2);
-    } else if (!strncmp(&CUR, "~^", 2)) {
-        l->token = TOK(BITXOR, 2);
-    } else {
-        return false;
-    }
+    if (t != TOK_INVALID)
+        span = 2;
+    else
+        t = LX_SYMBOLS[(u8)CUR];
 
-    l->token.pos = POS_HERE(2);
-    l->cur += 2;
+    l->token = (Token){
+        .kind = t,
+        .pos = POS_HERE(span),
+    };
 
-    return true;
+    l->cur += span;
 }
 
-static bool lx_next_single_symbol(Lexer* l) {
-    if (!lx_is_separator(CUR) && !lx_is_operator_start(CUR))
-        return false;
+static const char LX_ESCAPES[256] = {
+    ['a'] = '\a',  ['b'] = '\b',   ['e'] = '\033', ['n'] = '\n', ['r'] = '\r',
+    ['t'] = '\t',  ['\\'] = '\\', ['\''] = '\'',  ['"'] = '"',
+};
 
-    const TokenKind TABLE[] = {
-        ['{'] = TOK_LCURLY,   ['}'] = TOK_RCURLY, ['['] = TOK_LBRACKET,
-        [']'] = TOK_RBRACKET, ['('] = TOK_LPAREN, [')'] = TOK_RPAREN,
-        [':'] = TOK_COLON,    [','] = TOK_COMMA,  [';'] = TOK_SEMICOLON,
-        ['>'] = TOK_LT,       ['<'] = TOK_GT,     ['='] = TOK_EQ,
-        ['*'] = TOK_MUL,      ['/'] = TOK_DIV,    ['+'] = TOK_ADD,
-        ['-'] = TOK_SUB,      ['^'] = TOK_CARET,  ['&'] = TOK_BITAND,
-        ['|'] = TOK_BITOR,    ['.'] = TOK_DOT,    ['~'] = TOK_BITNOT,
-    };
+i32 lx_escape(char c) {
+    char res = LX_ESCAPES[(u8)c];
+    return res ? res : -1;
+}
 
-    TokenKind t;
-    if ((t = TABLE[(i8)CUR]) == 0)
-        return false;
+usize lx_unescape(char* out, const char* s, usize len) {
+    usize n = 0;
+    while (len) {
+        const char* bs = memchr(s, '\\', len);
+        usize run = bs ? (usize)(bs - s) : len;
+        memcpy(&out[n], s, run);
+        n += run;
+        if (!bs || run + 1 >= len)
+            break;
 
-    l->token = (Token){
-        .kind = t,
-        .pos = POS_HERE(1),
-    };
+        i32 c = lx_escape(bs[1]);
+        out[n++] = c < 0 ? bs[1] : c;
+        s += run + 2;
+        len -= run + 2;
+    }
+
+    return n;
+}
+
+static bool lx_next_delimited(Lexer* l) {
+    const u32 begin = l->cur;
+    const char delim = CUR;
+    Escapes esc = ESC_NONE;
+    l->cur++;
+
+    while (IN_BOUNDS) {
+        l->cur += scan_delim(&CUR, l->src_len - l->cur, delim);
+
+        if (!IN_BOUNDS || CUR == delim)
+            break;
+
+        // the scan stops at every backslash anyway, so check the escape here
+        // and spare the parser from looking for them again
+        if (esc != ESC_INVALID)
+            esc = l->cur + 1 < l->src_len && LX_ESCAPES[(u8)PEEK]
+                      ? ESC_VALID
+                      : ESC_INVALID;
+
+        // skip the backslash and whatever it escapes
+        l->cur += 2;
+    }
+
+    u32 len = l->cur - begin;
+    if (!IN_BOUNDS) {
+        l->error = ERROR(EOF, 1);
+        return false;
+    }
 
     l->cur++;
+    len++;
 
+    // strip the delimiters
+    Slice res = {.offset = begin + 1, .len = len - 2};
+    TokenKind k = (delim == '\'') ? TOK_LITERAL_CHAR : TOK_LITERAL_STRING;
+
+    l->token = (Token){
+        .kind = k,
+        .pos = POS(len),
+        .data.slice = res,
+        .escapes = esc,
+    };
     return true;
 }
 
-static bool lx_next_word(Lexer* l, a_string* res) {
-    const char* begin = &CUR;
-    u32 len = 0;
-    const char DELIMS[] = "\"'";
-    bool delimited_literal = strchr(DELIMS, *begin);
-    bool num = isdigit(*begin);
-    char delim = 0;
+// scans a word, returning the state the DFA finished in
+static WordState lx_next_word(Lexer* l, Slice* res) {
+    const u32 begin = l->cur;
+    WordState state = WS_START, next;
 
-    if (delimited_literal) {
-        delim = CUR;
+    while (IN_BOUNDS && (next = LX_WORD_DFA[state][CLASS_OF(CUR)]) != WS_END) {
+        state = next;
         l->cur++;
-        len++;
     }
 
-    do {
-        bool stop;
-
-        if (!IN_BOUNDS)
-            break;
+    *res = (Slice){.offset = begin, .len = l->cur - begin};
+    return state;
+}
 
-        if (delimited_literal)
-            stop = CUR == delim;
-        else
-            stop = lx_is_operator_start(CUR) ||
-                   (lx_is_separator(CUR) && (num && CUR != '.')) ||
-                   isspace(CUR) || strchr(DELIMS, CUR);
+// every power of ten that a double holds exactly
+static const f64 LX_POW10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
 
-        if (CUR == '\\') {
-            len++;
-            l->cur++;
+static Number lx_decode_real(const char* s, u32 len) {
+    Number res = {.len = len, .kind = NUM_REAL};
+
+    // when both the digits and the power of ten are exact doubles, a single
+    // division is correctly rounded
+    u64 m = 0;
+    u32 digits = 0, scale = 0;
+    bool frac = false;
+    for (u32 i = 0; i < len; i++) {
+        if (s[i] == '.') {
+            frac = true;
+            continue;
         }
 
-        if (stop)
+        scale += frac;
+        if (digits == 0 && s[i] == '0')
+            continue;
+
+        if (++digits > 19)
             break;
+        m = m * 10 + (s[i] - '0');
+    }
 
-        len++;
-        l->cur++;
-    } while (1);
+    if (digits <= 19 && m <= (1ull << 53) && scale <= 22) {
+        res.real = (f64)m / LX_POW10[scale];
+        return res;
+    }
 
-    if (delimited_literal) {
-        if (!IN_BOUNDS) {
-            l->error = ERROR(EOF, 1);
-            return false;
-        }
-        if (CUR != delim) {
-            if (strchr(DELIMS, CUR) != NULL)
-                l->error = ERROR(MISMATCHED_DELIMITER, len);
-            else
-                l->error = ERROR(UNTERMINATED_LITERAL, len);
-            return false;
-        } else {
-            l->cur++;
-            len++;
+    // too many digits for that, so leave it to libc
+    char buf[64];
+    char* copy = len < sizeof(buf) ? buf : malloc(len + 1);
+    check_alloc(copy);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    res.real = strtod(copy, NULL);
+    if (copy != buf)
+        free(copy);
+
+    if (isinf(res.real))
+        res.kind = NUM_OUT_OF_RANGE;
+    return res;
+}
+
+// like strtoll with base 0, a leading zero makes the rest octal
+static Number lx_decode_integer(const char* s, u32 len) {
+    Number res = {.len = len, .kind = NUM_INTEGER};
+
+    u32 base = (len > 1 && s[0] == '0') ? 8 : 10;
+    u64 v = 0;
+    bool overflow = false;
+    for (u32 i = 0; i < len; i++) {
+        u32 d = s[i] - '0';
+        if (d >= base) {
+            res.kind = overflow ? NUM_OUT_OF_RANGE : NUM_INVALID;
+            res.end = i;
+            return res;
         }
-    }
 
-    *res = as_new();
-    as_ncopy_cstr(res, begin, len);
+        overflow |= __builtin_mul_overflow(v, base, &v);
+        overflow |= __builtin_add_overflow(v, d, &v);
+        overflow |= v > INT64_MAX;
+    }
 
-    return true;
+    if (overflow)
+        res.kind = NUM_OUT_OF_RANGE;
+    else
+        res.integer = (i64)v;
+    return res;
 }
 
-static bool lx_next_keyword(Lexer* l, const a_string* word) {
-    if (word->len >= LX_KWT_STRSZ)
-        return false;
+static bool is_case_consistent(const char* s, usize len) {
+    if (!len)
+        return true;
 
-    TokenKind kw;
+    bool upper = isupper(s[0]), is_upper;
+    for (usize i = 1; i < len; i++) {
+        is_upper = isupper(s[i]);
+        if (is_upper != upper)
+            return false;
+    }
 
-    if (!as_is_case_consistent(word))
-        return false;
+    return true;
+}
 
-    a_string word_lower = as_tolower(word);
-    if ((kw = lx_kwt_get(word_lower.data)) != TOK_INVALID) {
-        l->token = TOKEN(kw, word_lower.len);
-        as_free(&word_lower);
-        return true;
-    } else {
-        as_free(&word_lower);
-        return false;
+// exact, case insensitive comparison against a lowercase C string
+static bool word_is(const char* s, usize len, const char* lower) {
+    usize i = 0;
+    for (; i < len && lower[i]; i++) {
+        if (tolower(s[i]) != lower[i])
+            return false;
     }
+
+    return i == len && lower[i] == '\0';
 }
 
-static bool is_number(const a_string* word) {
-    // edge case: single decimal
-    if (as_first(word) == '.' && word->len == 1)
+static bool lx_next_keyword(Lexer* l, const Slice* word) {
+    const char* w = WORD(word);
+    TokenKind kw;
+
+    if ((kw = lx_kwt_get(w, word->len)) == TOK_INVALID)
         return false;
 
-    bool found_decimal = false;
-    for (usize i = 0; i < word->len; i++) {
-        char cur = as_at(word, i);
+    // keywords must be either all uppercase or all lowercase
+    if (!is_case_consistent(w, word->len))
+        return false;
 
-        if (isdigit(cur))
-            continue;
+    l->token = TOKEN(kw, word->len);
+    return true;
+}
 
-        if (cur == '.') {
-            if (found_decimal)
-                return false;
-            else
-                found_decimal = true;
+static bool lx_next_boolean(Lexer* l, const Slice* word) {
+    const char* w = WORD(word);
+    bool val;
 
-            continue;
-        }
+    if (word_is(w, word->len, "true"))
+        val = true;
+    else if (word_is(w, word->len, "false"))
+        val = false;
+    else
+        return false;
 
+    if (!is_case_consistent(w, word->len))
         return false;
-    }
 
+    l->token = (Token){
+        .kind = TOK_LITERAL_BOOLEAN,
+        .pos = POS(word->len),
+        .data.boolean = val,
+    };
     return true;
 }
 
-static bool lx_next_literal(Lexer* l, const a_string* word) {
-    char* p;
-
-    if ((p = strchr("\"'", as_first(word)))) {
-        if (word->len == 1)
-            unreachable;
+Token* lx_next_token(Lexer* l) {
+    l->token = (Token){0};
+    l->error = (LexerError){0};
 
-        a_string res = as_slice(word, 1, word->len - 1);
-        TokenKind k = (*p == '\'') ? TOK_LITERAL_CHAR : TOK_LITERAL_STRING;
+    lx_trim_spaces(l);
 
+    if (l->cur >= l->src_len) {
+        // an unterminated block comment can leave cur past the end
         l->token = (Token){
-            .kind = k,
-            .pos = POS(word->len),
-            .data.string = res,
+            .kind = TOK_EOF,
+            .pos = {.offset = l->src_len, .span = 1},
         };
-        return true;
+        goto done;
     }
 
-    if (is_number(word)) {
-        a_string new = as_dupe(word);
-        if (!as_valid(&new))
-            panic("failed to dupe a_string for number");
+    CharClass first = CLASS_OF(CUR);
+    if (first == CC_NEWLINE) {
+        l->cur++;
+        l->token = TOK(NEWLINE, 1);
+        goto done;
+    }
 
-        l->token = (Token){
-            .kind = TOK_LITERAL_NUMBER,
-            .pos = POS(word->len),
-            .data.string = new,
-        };
-        return true;
+    if (first >= CC_DOT) {
+        lx_next_symbol(l, first);
+        goto done;
     }
 
-    if (as_is_case_consistent(word)) {
-        if (as_equal_case_insensitive_cstr(word, "true")) {
+    if (first == CC_QUOTE) {
+        if (!lx_next_delimited(l))
+            return NULL;
+        goto done;
+    }
+
+    Slice word = {0};
+    switch (lx_next_word(l, &word)) {
+        case WS_INTEGER:
             l->token = (Token){
-                .kind = TOK_LITERAL_BOOLEAN,
-                .pos = POS(word->len),
-                .data.boolean = true,
+                .kind = TOK_LITERAL_NUMBER,
+                .pos = POS(word.len),
+                .data.slice = word,
+                .number = lx_decode_integer(WORD(&word), word.len),
             };
-            return true;
-        } else if (as_equal_case_insensitive_cstr(word, "false")) {
+            goto done;
+        case WS_REAL:
             l->token = (Token){
-                .kind = TOK_LITERAL_BOOLEAN,
-                .pos = POS(word->len),
-                .data.boolean = false,
+                .kind = TOK_LITERAL_NUMBER,
+                .pos = POS(word.len),
+                .data.slice = word,
+                .number = lx_decode_real(WORD(&word), word.len),
             };
-            return true;
-        }
+            goto done;
+        case WS_IDENT:
+            TRY(lx_next_keyword(l, &word));
+            TRY(lx_next_boolean(l, &word));
+            l->token = (Token){
+                .kind = TOK_IDENT,
+                .data.slice = word,
+                .atom = at_intern(l->atoms, WORD(&word), word.len),
+                .pos = POS(word.len),
+            };
+            goto done;
+        default:
+            l->error = ERROR(INVALID_IDENTIFIER, word.len);
+            return NULL;
     }
 
-    return false;
+done:
+    return &l->token;
 }
 
-static bool is_ident(const a_string* s) {
-    char first = as_first(s);
-    if (!isalpha(first) && first != '_')
-        return false;
+#define TOKENS_INITIAL_SIZE 256
 
-    for (size_t i = 0; i < s->len; i++) {
-        char ch = as_at(s, i);
-        if (!isalnum(ch) && !strchr("_.", ch))
-            return false;
-    }
+// string and char literal payloads keep their escapes above their length
+#define ESCAPES_SHIFT 30
+#define LENGTH_MASK   ((1u << ESCAPES_SHIFT) - 1)
 
-    return true;
+#define GROW(arr, cap)                                                         \
+    do {                                                                       \
+        (arr) = realloc((arr), sizeof(*(arr)) * (cap));                        \
+        check_alloc((arr));                                                    \
+    } while (0)
+
+// makes room for n more tokens
+static void tokens_reserve(Tokens* ts, usize n) {
+    if (ts->len + n <= ts->cap)
+        return;
+
+    usize cap = ts->cap ? ts->cap : TOKENS_INITIAL_SIZE;
+    while (cap < ts->len + n)
+        cap *= 2;
+
+    ts->cap = cap;
+    GROW(ts->kinds, ts->cap);
+    GROW(ts->offsets, ts->cap);
+    GROW(ts->lens, ts->cap);
+    GROW(ts->payloads, ts->cap);
 }
 
-static bool lx_next_ident(Lexer* l, const a_string* word) {
-    if (is_ident(word)) {
-        a_string new = as_dupe(word);
-        if (!as_valid(&new))
-            panic("failed to dupe a_string for ident");
+static void tokens_append(Tokens* ts, const Token* t) {
+    tokens_reserve(ts, 1);
 
-        l->token = (Token){
-            .kind = TOK_IDENT,
-            .data.string = new,
-            .pos = POS(new.len),
-        };
-        return true;
-    } else {
-        l->error = ERROR(INVALID_IDENTIFIER, word->len);
-        return false;
+    u32 payload;
+    switch (t->kind) {
+        case TOK_IDENT: payload = t->atom; break;
+        case TOK_LITERAL_BOOLEAN: payload = t->data.boolean; break;
+        case TOK_LITERAL_STRING:
+        case TOK_LITERAL_CHAR: {
+            payload = (t->data.slice.len + 2) |
+                      (u32)t->escapes << ESCAPES_SHIFT;
+        } break;
+        case TOK_LITERAL_NUMBER: {
+            payload = ts->numbers.len;
+            av_append(&ts->numbers, t->number);
+        } break;
+        default: payload = t->pos.span; break;
     }
+
+    usize i = ts->len++;
+    ts->kinds[i] = t->kind;
+    ts->offsets[i] = t->pos.offset;
+    ts->lens[i] = t->pos.span;
+    ts->payloads[i] = payload;
 }
 
-Token* lx_next_token(Lexer* l) {
-    if (l->error.kind != LX_ERROR_NULL) {
-        token_free(&l->token);
+// appends another token stream, moving its idents over into atoms
+static void tokens_extend(Tokens* ts, const Tokens* from, AtomTable* atoms) {
+    // a chunk with nothing but whitespace in it never allocated its arrays
+    if (!from->len)
+        return;
+
+    tokens_reserve(ts, from->len);
+
+    usize base = ts->len;
+    memcpy(&ts->kinds[base], from->kinds, from->len * sizeof(*ts->kinds));
+    memcpy(&ts->offsets[base], from->offsets,
+           from->len * sizeof(*ts->offsets));
+    memcpy(&ts->lens[base], from->lens, from->len * sizeof(*ts->lens));
+    memcpy(&ts->payloads[base], from->payloads,
+           from->len * sizeof(*ts->payloads));
+    ts->len += from->len;
+
+    usize nbase = ts->numbers.len;
+    if (from->numbers.len) {
+        av_append_many(&ts->numbers, from->numbers.data, from->numbers.len);
+        for (usize i = base; i < ts->len; i++)
+            if (ts->kinds[i] == TOK_LITERAL_NUMBER)
+                ts->payloads[i] += nbase;
     }
 
-    l->token = (Token){0};
-    l->error = (LexerError){0};
+    // the other stream's atoms were handed out in the order their names were
+    // first seen in it, so interning them again in that order hands out the
+    // same atoms as lexing both streams one after the other would have
+    u32 natoms = from->atoms->entries.len;
+    if (natoms == 0)
+        return;
 
-    lx_trim_spaces(l);
-    if (l->cur >= l->src_len) {
-        l->token = TOK(EOF, 1);
-        goto done;
+    Atom* map = malloc(natoms * sizeof(Atom));
+    check_alloc(map);
+    for (Atom a = 0; a < natoms; a++)
+        map[a] = at_intern(atoms, at_str(from->atoms, a),
+                           at_len(from->atoms, a));
+
+    for (usize i = base; i < ts->len; i++)
+        if (ts->kinds[i] == TOK_IDENT)
+            ts->payloads[i] = map[ts->payloads[i]];
+
+    free(map);
+}
+
+// replaces the tokens [begin, end) with another stream in the same atom table,
+// moving the tokens after them by shift bytes
+static void tokens_splice(Tokens* ts, usize begin, usize end,
+                          const Tokens* with, i32 shift) {
+    usize tail = ts->len - end;
+    if (with->len > end - begin)
+        tokens_reserve(ts, with->len - (end - begin));
+
+    // numbers are in the same order as their tokens, so the replaced ones are
+    // those right after the last number before begin
+    usize nbegin = 0;
+    for (usize i = begin; i-- > 0;) {
+        if (ts->kinds[i] == TOK_LITERAL_NUMBER) {
+            nbegin = ts->payloads[i] + 1;
+            break;
+        }
     }
 
-    if (CUR == '\n') {
-        l->token = TOK(NEWLINE, 1);
-        BUMP_NEWLINE;
-        goto done;
+    usize nend = nbegin;
+    for (usize i = begin; i < end; i++)
+        nend += ts->kinds[i] == TOK_LITERAL_NUMBER;
+
+    Numbers* nums = &ts->numbers;
+    usize nadded = with->numbers.len;
+    usize nlen = nums->len - (nend - nbegin) + nadded;
+    if (nlen > nums->cap)
+        av_reserve(nums, nlen);
+    if (nums->len > nend)
+        memmove(&nums->data[nbegin + nadded], &nums->data[nend],
+                (nums->len - nend) * sizeof(Number));
+    if (nadded)
+        memcpy(&nums->data[nbegin], with->numbers.data,
+               nadded * sizeof(Number));
+    nums->len = nlen;
+
+#define MOVE(arr)                                                              \
+    memmove(&(arr)[begin + with->len], &(arr)[end], tail * sizeof(*(arr)))
+    if (with->len != end - begin) {
+        MOVE(ts->kinds);
+        MOVE(ts->offsets);
+        MOVE(ts->lens);
+        MOVE(ts->payloads);
     }
+#undef MOVE
+
+    memcpy(&ts->kinds[begin], with->kinds, with->len * sizeof(*ts->kinds));
+    memcpy(&ts->offsets[begin], with->offsets,
+           with->len * sizeof(*ts->offsets));
+    memcpy(&ts->lens[begin], with->lens, with->len * sizeof(*ts->lens));
+    memcpy(&ts->payloads[begin], with->payloads,
+           with->len * sizeof(*ts->payloads));
+
+    ts->len = begin + with->len + tail;
+    if (shift != 0)
+        for (usize i = begin + with->len; i < ts->len; i++)
+            ts->offsets[i] += shift;
+
+    for (usize i = begin; i < begin + with->len; i++)
+        if (ts->kinds[i] == TOK_LITERAL_NUMBER)
+            ts->payloads[i] += nbegin;
+
+    if (nadded != nend - nbegin)
+        for (usize i = begin + with->len; i < ts->len; i++)
+            if (ts->kinds[i] == TOK_LITERAL_NUMBER)
+                ts->payloads[i] += nadded - (nend - nbegin);
+}
 
-    TRY(lx_next_double_symbol(l));
-    TRY(lx_next_single_symbol(l));
+#undef GROW
 
-    a_string word = {0};
-    if (!lx_next_word(l, &word)) // error
-        return NULL;
+Token tokens_get(const Tokens* ts, usize idx) {
+    Token res = {
+        .kind = ts->kinds[idx],
+        .pos = {.offset = ts->offsets[idx], .span = ts->lens[idx]},
+    };
 
-    TRY_AND_FREE(lx_next_keyword(l, &word));
-    TRY_AND_FREE(lx_next_literal(l, &word));
-    TRY_AND_FREE(lx_next_ident(l, &word));
+    u32 payload = ts->payloads[idx];
+    switch (res.kind) {
+        case TOK_IDENT: {
+            res.atom = payload;
+            res.data.slice =
+                (Slice){res.pos.offset, at_len(ts->atoms, payload)};
+        } break;
+        case TOK_LITERAL_BOOLEAN: {
+            res.data.boolean = payload;
+        } break;
+        case TOK_LITERAL_STRING:
+        case TOK_LITERAL_CHAR: {
+            // strip the delimiters
+            res.data.slice =
+                (Slice){res.pos.offset + 1, (payload & LENGTH_MASK) - 2};
+            res.escapes = payload >> ESCAPES_SHIFT;
+        } break;
+        case TOK_LITERAL_NUMBER: {
+            res.number = ts->numbers.data[payload];
+            res.data.slice = (Slice){res.pos.offset, res.number.len};
+        } break;
+        default: break;
+    }
 
-next_token_error:
-    as_free(&word);
-done:
-    return &l->token;
+    return res;
+}
+
+// where the lexer's cursor was left after the token
+static u32 tokens_end(const Tokens* ts, usize idx) {
+    Token t = tokens_get(ts, idx);
+    switch (t.kind) {
+        case TOK_IDENT:
+        case TOK_LITERAL_NUMBER: return t.data.slice.offset + t.data.slice.len;
+        case TOK_LITERAL_STRING:
+        case TOK_LITERAL_CHAR:
+            // past the closing delimiter
+            return t.data.slice.offset + t.data.slice.len + 1;
+        default: return t.pos.offset + t.pos.span;
+    }
+}
+
+void tokens_free(Tokens* ts) {
+    free(ts->kinds);
+    free(ts->offsets);
+    free(ts->lens);
+    free(ts->payloads);
+    av_free(&ts->numbers);
+    *ts = (Tokens){0};
 }
 
 bool lx_tokenize(Lexer* l, Tokens* out) {
-    *out = (Tokens){0};
+    *out = (Tokens){.atoms = l->atoms};
     Token* tok = {0};
 
     do {
@@ -688,18 +1030,237 @@ bool lx_tokenize(Lexer* l, Tokens* out) {
             return false;
         }
 
-        av_append(out, *tok);
+        tokens_append(out, tok);
     } while (!tok || tok->kind != TOK_EOF);
 
     return true;
 }
 
+bool lx_relex(Lexer* l, Tokens* toks, SourceEdit edit, TokenEdit* out) {
+    // nothing before a newline token looks past it, so lexing can start
+    // again right after the last newline before the edit
+    usize lo = 0, hi = toks->len;
+    while (lo < hi) {
+        usize mid = lo + (hi - lo) / 2;
+        if (toks->offsets[mid] < edit.offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    usize begin = lo;
+    while (begin > 0 && toks->kinds[begin - 1] != TOK_NEWLINE)
+        begin--;
+
+    // and it can stop once the cursor is past the edit and at the same place
+    // as it was after some old token, as everything after that is the same
+    // tokens, moved over
+    i64 shift = (i64)edit.inserted - edit.removed;
+    i64 edit_end = (i64)edit.offset + edit.removed;
+    l->cur = begin > 0 ? toks->offsets[begin - 1] + 1 : 0;
+
+    Tokens fresh = {.atoms = l->atoms};
+    usize old = begin;
+    usize end = toks->len;
+    while (true) {
+        Token* tok = lx_next_token(l);
+        if (!tok) {
+            lx_perror(l->error.kind, "\033[31;1mlexer error\033[0m");
+            tokens_free(&fresh);
+            return false;
+        }
+
+        tokens_append(&fresh, tok);
+        if (tok->kind == TOK_EOF)
+            break;
+
+        i64 old_cur = (i64)l->cur - shift;
+        if (old_cur < edit_end)
+            continue;
+
+        while (old < toks->len && tokens_end(toks, old) < old_cur)
+            old++;
+
+        if (old < toks->len && toks->kinds[old] != TOK_EOF &&
+            tokens_end(toks, old) == old_cur) {
+            end = old + 1;
+            break;
+        }
+    }
+
+    *out = (TokenEdit){
+        .begin = begin,
+        .old_end = end,
+        .new_end = begin + fresh.len,
+        .shift = shift,
+    };
+    tokens_splice(toks, begin, end, &fresh, shift);
+    tokens_free(&fresh);
+    return true;
+}
+
+#define LX_MAX_JOBS 64
+
+typedef struct {
+    const char* src;
+    usize src_len;
+    usize begin;
+    usize end; // just past a newline, or past the end of the source
+    usize stop; // where lexing actually stopped
+    bool ok;
+    bool eof;
+    LexerError error;
+    AtomTable atoms;
+    Tokens toks;
+} LexChunk;
+
+// lexes from begin until a token ends at or past end. this matches what a
+// single lexer does, as long as that lexer would also have stopped at begin.
+static void lx_lex_chunk(LexChunk* c) {
+    c->atoms = at_new();
+    c->toks = (Tokens){.atoms = &c->atoms};
+    c->ok = true;
+    c->eof = false;
+
+    Lexer l = lx_new(c->src, c->src_len, &c->atoms);
+    l.cur = c->begin;
+
+    do {
+        Token* tok = lx_next_token(&l);
+        if (!tok) {
+            c->ok = false;
+            c->error = l.error;
+            break;
+        }
+
+        tokens_append(&c->toks, tok);
+        if (tok->kind == TOK_EOF) {
+            c->eof = true;
+            break;
+        }
+    } while (l.cur < c->end);
+
+    c->stop = l.cur;
+}
+
+static int lx_chunk_worker(void* arg) {
+    lx_lex_chunk(arg);
+    return 0;
+}
+
+static void lx_chunk_free(LexChunk* c) {
+    tokens_free(&c->toks);
+    at_free(&c->atoms);
+}
+
+u32 lx_parallel_jobs(const Lexer* l, u32 jobs) {
+    if (jobs == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = n > 0 ? n : 1;
+    }
+
+    usize rest = l->src_len - l->cur;
+    if (jobs > rest / LX_CHUNK_MIN)
+        jobs = rest / LX_CHUNK_MIN;
+    if (jobs > LX_MAX_JOBS)
+        jobs = LX_MAX_JOBS;
+
+    return jobs;
+}
+
+bool lx_tokenize_parallel(Lexer* l, Tokens* out, u32 jobs) {
+    jobs = lx_parallel_jobs(l, jobs);
+    usize rest = l->src_len - l->cur;
+    if (jobs < 2)
+        return lx_tokenize(l, out);
+
+    // split roughly evenly, at the next newline. whether that newline is
+    // really between two tokens (and not in a string or block comment) is
+    // only found out when stitching.
+    LexChunk chunks[LX_MAX_JOBS];
+    u32 nchunks = 0;
+    usize begin = l->cur;
+    for (u32 i = 1; i <= jobs && begin <= l->src_len; i++) {
+        // the last chunk runs until EOF
+        usize end = l->src_len + 1;
+        if (i < jobs) {
+            usize want = l->cur + rest * i / jobs;
+            if (want < begin)
+                want = begin;
+            const char* nl = memchr(&l->src[want], '\n', l->src_len - want);
+            if (nl)
+                end = nl - l->src + 1;
+        }
+
+        chunks[nchunks++] = (LexChunk){
+            .src = l->src,
+            .src_len = l->src_len,
+            .begin = begin,
+            .end = end,
+        };
+        begin = end;
+    }
+
+    thrd_t threads[LX_MAX_JOBS];
+    bool spawned[LX_MAX_JOBS] = {0};
+    for (u32 i = 1; i < nchunks; i++)
+        spawned[i] = thrd_create(&threads[i], lx_chunk_worker, &chunks[i]) ==
+                     thrd_success;
+
+    lx_lex_chunk(&chunks[0]);
+    for (u32 i = 1; i < nchunks; i++) {
+        if (spawned[i])
+            thrd_join(threads[i], NULL);
+        else
+            lx_lex_chunk(&chunks[i]);
+    }
+
+    *out = (Tokens){.atoms = l->atoms};
+    usize cur = l->cur;
+    bool ok = true;
+    bool done = false;
+    for (u32 i = 0; i < nchunks; i++) {
+        LexChunk* c = &chunks[i];
+        if (done) {
+            lx_chunk_free(c);
+            continue;
+        }
+
+        if (c->begin != cur) {
+            // the chunk before ran past its split point, so this one started
+            // in the middle of something. lex it again from the right place.
+            lx_chunk_free(c);
+            if (cur >= c->end)
+                continue;
+
+            c->begin = cur;
+            lx_lex_chunk(c);
+        }
+
+        tokens_extend(out, &c->toks, l->atoms);
+        cur = c->stop;
+        if (!c->ok) {
+            l->error = c->error;
+            ok = false;
+        }
+        done = !c->ok || c->eof;
+        lx_chunk_free(c);
+    }
+
+    l->cur = cur;
+    if (!ok) {
+        lx_perror(l->error.kind, "\033[31;1mlexer error\033[0m");
+        return false;
+    }
+
+    return true;
+}
+
 void lx_free(Lexer* l) {
     (void)l;
-    lx_kwt_free();
 }
 
-static const char* LEXER_ERROR_TABLE[] = {
+static const char* const LEXER_ERROR_TABLE[] = {
     [LX_ERROR_NULL] = "(no error)",
     [LX_ERROR_UNTERMINATED_LITERAL] =
         "unterminated string or character literal",
@@ -727,7 +1288,5 @@ void lx_perror(LexerErrorKind k, const char* pre) {
 }
 
 void lx_reset(Lexer* l) {
-    l->row = 1;
-    l->bol = 0;
     l->cur = 0;
 }
@@ -12,25 +12,58 @@
 
 #include "a_string.h"
 #include "a_vector.h"
+#include "atom.h"
 #include "common.h"
 
 #include "lexer_types.h"
 
-AV_DECL(Token, Tokens)
+AV_DECL(Number, Numbers)
+
+// a whole token stream, stored as parallel arrays so that scanning the kinds
+// touches one byte per token. tokens_get unpacks a single token.
+typedef struct {
+    u8* kinds;
+    u32* offsets;
+    u16* lens; // same as the span, so capped at 65535
+    // the atom of an ident, the value of a boolean, the index of a number, the
+    // exact length of a string or char literal with its escapes in the top
+    // bits, or the exact length of anything else
+    u32* payloads;
+    // the decoded number literals, in the same order as their tokens
+    Numbers numbers;
+    // where the ident atoms come from, not owned
+    const AtomTable* atoms;
+    usize len;
+    usize cap;
+} Tokens;
+
+Token tokens_get(const Tokens* ts, usize idx);
+void tokens_free(Tokens* ts);
 
-Token token_new_ident(const char* str);
 const char* token_kind_string(TokenKind k);
-void token_print_long(Token* t);
+void token_print_long(Token* t, const char* src);
 void token_print(Token* t);
-Token token_dupe(Token* t);
 
-// free heap allocated data.
-// of course, you can still read the kind if you have to.
-void token_free(Token* t);
+// makes an owned copy of the slice held by a token.
+a_string token_to_string(const Token* t, const char* src);
 
+// the character an escape like \n stands for, or -1 if it is not one
+i32 lx_escape(char c);
+// writes out a string or char literal with its escapes resolved, returning
+// how many bytes were written. out needs room for len bytes.
+usize lx_unescape(char* out, const char* s, usize len);
+
+// all lexer state lives in here, and apart from the atom table, everything
+// else the lexer uses is immutable. nothing but the cursor is kept from one
+// token to the next, so a lexer can be started anywhere a token would start,
+// and lexes the rest just as it would have. any number of lexers can run at
+// once, on any threads, as long as each one is only used by a single thread
+// at a time and lexers on different threads do not share an atom table.
 typedef struct {
     const char* src;
     usize src_len;
+    // identifiers are interned into here
+    AtomTable* atoms;
 
     // current token (public)
     Token token;
@@ -40,11 +73,10 @@ typedef struct {
 
     // internal lexer state
     u32 cur;
-    u32 row;
-    u32 bol;
 } Lexer;
 
-Lexer lx_new(const char* src, usize src_len);
+// requires src and atoms to outlive the lexer
+Lexer lx_new(const char* src, usize src_len, AtomTable* atoms);
 Token* lx_next_token(Lexer* l);
 void lx_free(Lexer* l);
 void lx_reset(Lexer* l);
@@ -53,4 +85,38 @@ a_string lx_as_strerror(LexerErrorKind e);
 void lx_perror(LexerErrorKind e, const char* pre);
 bool lx_tokenize(Lexer* l, Tokens* out);
 
+// a change to a source: the bytes [offset, offset + removed) of the old source
+// were replaced by inserted new bytes
+typedef struct {
+    u32 offset;
+    u32 removed;
+    u32 inserted;
+} SourceEdit;
+
+// the tokens [begin, old_end) were replaced by [begin, new_end), and every
+// token after them moved by shift bytes
+typedef struct {
+    usize begin;
+    usize old_end;
+    usize new_end;
+    i32 shift;
+} TokenEdit;
+
+// updates toks, lexed from the old source, to match the new source after
+// edit, lexing again only the tokens the edit could have changed. l must lex
+// the new source into the same atom table as toks. on a lexer error, toks are
+// left as they were and false is returned.
+bool lx_relex(Lexer* l, Tokens* toks, SourceEdit edit, TokenEdit* out);
+
+// chunks smaller than this are not worth a thread of their own
+#define LX_CHUNK_MIN (256 * 1024)
+
+// like lx_tokenize, but splits the source into chunks at newlines and lexes
+// them on up to jobs threads (0 for one per cpu). the tokens, atoms and
+// errors are exactly the same as lx_tokenize's. small sources are lexed on
+// the calling thread.
+bool lx_tokenize_parallel(Lexer* l, Tokens* out, u32 jobs);
+// how many threads lx_tokenize_parallel would really use
+u32 lx_parallel_jobs(const Lexer* l, u32 jobs);
+
 #endif // _LEXER_H
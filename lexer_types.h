@@ -11,14 +11,22 @@
 #define _LEXER_TYPES_H
 
 #include "a_string.h"
+#include "atom.h"
 #include "common.h"
 
+// rows and columns are worked out from the offset only when they are needed,
+// see lines.h
 typedef struct {
-    u32 row;
-    u32 col;
+    u32 offset; // into the source
     u16 span;
 } Pos;
 
+// a view into the lexer's source buffer. only valid while the source lives.
+typedef struct {
+    u32 offset;
+    u32 len;
+} Slice;
+
 typedef enum {
     LX_ERROR_NULL = 0,
     LX_ERROR_UNTERMINATED_LITERAL,
@@ -84,6 +92,8 @@ typedef enum {
     TOK_UNTIL,
     TOK_STRUCT,
     TOK_ENDSTRUCT,
+    TOK_SCOPE,
+    TOK_ENDSCOPE,
 
     // Types
     TOK_INTEGER,
@@ -126,13 +136,41 @@ typedef enum {
     TOK_BITXOR,
 } TokenKind;
 
+typedef enum {
+    NUM_INTEGER = 0,
+    NUM_REAL,
+    NUM_OUT_OF_RANGE, // too large or too small for its type
+    NUM_INVALID,      // a digit that is not allowed, see Number.end
+} NumberKind;
+
+// a number literal, decoded once by the lexer
+typedef struct {
+    union {
+        i64 integer;
+        f64 real;
+        u32 end; // for NUM_INVALID, where decoding stopped
+    };
+    u32 len; // of the literal
+    u8 kind; // a NumberKind
+} Number;
+
+// what the escapes in a string or char literal look like
+typedef enum {
+    ESC_NONE = 0, // the literal is just its source text
+    ESC_VALID,
+    ESC_INVALID, // at least one escape is not recognized
+} Escapes;
+
 typedef struct {
     TokenKind kind;
     Pos pos;
     union {
-        a_string string; // idents, other literals
-        bool boolean;    // bool literals
+        Slice slice;  // idents, other literals
+        bool boolean; // bool literals
     } data;
+    Atom atom;     // idents only
+    Number number; // number literals only
+    u8 escapes;    // string and char literals only, an Escapes
 } Token;
 
 #endif // _LEXER_TYPES_H
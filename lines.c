@@ -0,0 +1,80 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "lines.h"
+#include "scan.h"
+
+LineIndex li_new(const char* src, usize src_len) {
+    return (LineIndex){.src = src, .src_len = src_len};
+}
+
+void li_free(LineIndex* li) {
+    free(li->starts);
+    *li = (LineIndex){0};
+}
+
+static void li_build(LineIndex* li) {
+    usize newlines = scan_count_newlines(li->src, li->src_len);
+
+    li->starts = malloc(sizeof(u32) * (newlines + 1));
+    check_alloc(li->starts);
+
+    // find the newlines, then turn each into the start of the next line
+    li->starts[0] = 0;
+    scan_find_newlines(li->src, li->src_len, &li->starts[1]);
+    for (usize i = 1; i <= newlines; i++)
+        li->starts[i]++;
+
+    li->count = newlines + 1;
+}
+
+LineCol li_locate(LineIndex* li, u32 offset) {
+    if (!li->count)
+        li_build(li);
+
+    // the last line starting at or before offset
+    u32 lo = 0, hi = li->count;
+    while (hi - lo > 1) {
+        u32 mid = lo + (hi - lo) / 2;
+        if (li->starts[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return (LineCol){.row = lo + 1, .col = offset - li->starts[lo] + 1};
+}
+
+void li_print_span(LineIndex* li, Pos pos) {
+    if (pos.offset > li->src_len)
+        return;
+
+    LineCol lc = li_locate(li, pos.offset);
+    const char* line = &li->src[li->starts[lc.row - 1]];
+    usize end = lc.row < li->count ? li->starts[lc.row] - 1 : li->src_len;
+    int len = (int)(&li->src[end] - line);
+    if (len > 0 && line[len - 1] == '\r')
+        len--;
+
+    eprintf(" %5u | %.*s\n", lc.row, len, line);
+    eprintf("       | ");
+
+    // keep tabs, so that the caret lines up
+    for (u32 i = 0; i + 1 < lc.col; i++)
+        fputc(line[i] == '\t' ? '\t' : ' ', stderr);
+
+    eprintf("\033[31;1m^");
+    for (u32 i = 1; i < pos.span && lc.col + i <= (u32)len; i++)
+        fputc('~', stderr);
+    eprintf("\033[0m\n");
+}
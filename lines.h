@@ -0,0 +1,40 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _LINES_H
+#define _LINES_H
+
+#include "common.h"
+#include "lexer_types.h"
+
+// turns source offsets into rows and columns. positions only carry offsets,
+// so this is only needed once a diagnostic is printed, and the line starts
+// are not scanned for until then.
+typedef struct {
+    const char* src;
+    usize src_len;
+    u32* starts; // offset of the first byte of every line
+    u32 count;   // 0 until the first lookup
+} LineIndex;
+
+// 1-based
+typedef struct {
+    u32 row;
+    u32 col;
+} LineCol;
+
+// requires src to outlive the index
+LineIndex li_new(const char* src, usize src_len);
+void li_free(LineIndex* li);
+
+LineCol li_locate(LineIndex* li, u32 offset);
+// prints the line pos is on to stderr, with the span underlined
+void li_print_span(LineIndex* li, Pos pos);
+
+#endif // _LINES_H
@@ -13,16 +13,24 @@
 #include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <threads.h>
+#include <unistd.h>
 
 #include "a_string.h"
 #include "a_vector.h"
+#include "arena.h"
 #include "ast.h"
+#include "ast_cache.h"
 #include "ast_printer.h"
+#include "atom.h"
 #include "common.h"
 #include "compiler/compiler.h"
 #include "lexer.h"
+#include "lines.h"
 #include "parser/parser.h"
+#include "source.h"
 
 #define _UTIL_H_IMPLEMENTATION
 #include "util.h"
@@ -30,9 +38,12 @@
 typedef struct {
     a_string in_path;
     a_string out_path;
+    a_string cache_dir;
     bool has_in_path;
     bool has_out_path;
+    bool has_cache_dir;
     bool debug;
+    u32 jobs; // 0 if not given, for one per cpu
     bool no_compile;
     bool help;
 } Args;
@@ -40,6 +51,8 @@ typedef struct {
 static const struct option LONG_OPTS[] = {
     {"out-path", required_argument, 0, 'o'},
     {"debug", required_argument, 0, 'd'},
+    {"jobs", required_argument, 0, 'j'},
+    {"cache-dir", required_argument, 0, 'C'},
     {"no-compile", required_argument, 0, 'N'},
     {"help", required_argument, 0, 'h'},
     {0},
@@ -56,6 +69,11 @@ static Args args;
 void help(void) {
     puts("  --out-path, -o: specify output path (default: out.qbe)");
     puts("  --debug, -d: print extra debugging info");
+    puts("  --jobs, -j: lex large files on this many threads (default: all)");
+    puts("    and parse them on as many too, which keeps the whole program in "
+         "memory. otherwise statements are compiled as they are parsed");
+    puts("  --cache-dir, -C: keep parsed programs in this directory, so that "
+         "unchanged files are not lexed or parsed again");
     puts("  --no-compile, -N: don't actually compile anything");
 }
 
@@ -63,7 +81,7 @@ bool parse_args(int argc, char** argv) {
     args = (Args){0};
 
     int c = 0;
-    while ((c = getopt_long(argc, argv, "o:dhN", LONG_OPTS, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "o:dj:C:hN", LONG_OPTS, NULL)) != -1) {
         switch (c) {
             case 'o': {
                 args.out_path = astr(optarg);
@@ -72,6 +90,17 @@ bool parse_args(int argc, char** argv) {
             case 'd': {
                 args.debug = true;
             } break;
+            case 'j': {
+                char* end;
+                long n = strtol(optarg, &end, 10);
+                if (*end != '\0' || n < 1)
+                    fatal("invalid number of jobs \"%s\"", optarg);
+                args.jobs = n;
+            } break;
+            case 'C': {
+                args.cache_dir = astr(optarg);
+                args.has_cache_dir = true;
+            } break;
             case 'N': {
                 args.no_compile = true;
             } break;
@@ -101,63 +130,141 @@ void init(int argc, char** argv) {
     parse_args(argc, argv);
 }
 
-static a_string file_content;
+static SourceFile file_content;
 static a_string file_name;
+static AtomTable atoms;
+static LineIndex lines;
 static Lexer l;
 static Tokens toks;
 static Parser ps;
 static CB_Program prog;
+static AstCache cache;
 static AstPrinter printer;
 static Compiler comp;
 
+static void open_compiler(void) {
+    if (args.has_out_path) {
+        if (!cm_new_with_file_writer(args.out_path.data, &comp))
+            panic("could not open %s", args.out_path.data);
+    } else {
+        comp = cm_new();
+    }
+}
+
 void compile(void) {
     if (!args.has_in_path) {
         file_name = astr("(stdin)");
-        file_content = as_new();
-        if (!as_read_line(&file_content, stdin))
-            panic("could not read line from stdin");
+        if (!sf_read_fd(STDIN_FILENO, &file_content))
+            panic("could not read from stdin: %s", strerror(errno));
     } else {
         file_name = astr(args.in_path.data);
-        file_content = as_read_file(args.in_path.data);
-        if (errno == ENOENT)
-            panic("file \"%s\" not found", args.in_path.data);
+        if (!sf_open(args.in_path.data, &file_content)) {
+            if (errno == ENOENT)
+                panic("file \"%s\" not found", args.in_path.data);
+            else
+                panic("could not read \"%s\": %s", args.in_path.data,
+                      strerror(errno));
+        }
     }
 
-    l = lx_new(file_content.data, file_content.len);
+    atoms = at_new();
+    lines = li_new(file_content.data, file_content.len);
 
-    toks = (Tokens){0};
-    if (!lx_tokenize(&l, &toks))
-        return;
-
-    if (args.debug) {
-        eprintf("\x1b[2m=== TOKENS ===\n");
-        for (usize i = 0; i < toks.len; i++) {
-            token_print_long(&toks.data[i]);
+    // an unchanged source is not lexed or parsed at all. the dump needs the
+    // tokens though, so it never comes from the cache.
+    bool ok;
+    bool use_cache = args.has_cache_dir && !args.debug;
+    u64 key = 0;
+    if (use_cache) {
+        key = ac_key(file_content.data, file_content.len);
+        if (ac_load(args.cache_dir.data, key, file_content.len, &atoms,
+                    &cache)) {
+            open_compiler();
+            ok = cm_program(&comp, &cache.prog, &file_name, &lines);
+            goto compiled;
         }
-        eprintf("==============\x1b[0m\n");
     }
 
-    ps = ps_new(toks.data, toks.len, as_dupe(&file_name));
+    l = lx_new(file_content.data, file_content.len, &atoms);
 
-    if (!ps_program(&ps, &prog)) {
-        eprintf("error\n");
-        return;
-    }
+    // the whole token stream is needed up front to dump it, and big sources
+    // are quicker to lex up front on several threads, if there are several
+    bool parallel = lx_parallel_jobs(&l, args.jobs) > 1;
+    if (args.debug || parallel) {
+        toks = (Tokens){0};
+        if (!lx_tokenize_parallel(&l, &toks, args.jobs))
+            return;
+
+        if (args.debug) {
+            eprintf("\x1b[2m=== TOKENS ===\n");
+            for (usize i = 0; i < toks.len; i++) {
+                Token t = tokens_get(&toks, i);
+                token_print_long(&t, file_content.data);
+            }
+            eprintf("==============\x1b[0m\n");
+        }
 
-    if (args.debug) {
-        printer = ap_new_with_stderr_writer();
-        ap_visit_program(&printer, &prog);
-        putchar('\n');
+        ps = ps_new(&toks, &lines, as_dupe(&file_name));
+    } else {
+        // otherwise, tokens are lexed as the parser asks for them
+        ps = ps_new_with_lexer(&l, &lines, as_dupe(&file_name));
     }
 
-    if (args.has_out_path) {
-        if (!cm_new_with_file_writer(args.out_path.data, &comp))
-            panic("could not open %s", args.out_path.data);
+    // so that the compiler can reuse what it worked out for an expression
+    // that comes up again
+    cb_exprs_share(&ps.exprs);
+
+    open_compiler();
+
+    // parsing on several threads needs the whole program in memory, so it is
+    // only done when asked for
+    bool parallel_parse = args.jobs && ps_parallel_jobs(&ps, args.jobs) > 1;
+    if (args.debug || use_cache || parallel_parse) {
+        // the whole program is needed up front to dump or cache it, or to
+        // parse it on several threads
+        if (!ps_program_parallel(&ps, &prog, args.jobs)) {
+            eprintf("error\n");
+            return;
+        }
+
+        if (use_cache &&
+            !ac_store(args.cache_dir.data, key, file_content.len, &prog))
+            warn("could not cache the program in %s: %s", args.cache_dir.data,
+                 strerror(errno));
+
+        if (args.debug) {
+            printer = ap_new_with_stderr_writer();
+            ap_visit_program(&printer, &prog);
+            putchar('\n');
+        }
+
+        ok = cm_program(&comp, &prog, &file_name, &lines);
     } else {
-        comp = cm_new();
+        // otherwise, each statement is compiled and freed as soon as it is
+        // parsed, so only one is ever alive at a time
+        bool compiling = true;
+        cm_program_begin(&comp, &ps.exprs, &atoms, &file_name, &lines);
+        while (ps_next_stmt(&ps)) {
+            // after a parse error nothing more is compiled, but the rest of
+            // the errors are still worth reporting
+            if (compiling && !ps.error_count)
+                compiling = cm_program_stmt(&comp, &ps.stmt);
+
+            sf_release(&file_content, ps.stmt.pos.offset);
+            cb_exprs_truncate(&ps.exprs, 0);
+            ar_reset(&ps.arena);
+        }
+
+        if (ps.error_count) {
+            eprintf("error\n");
+            return;
+        }
+
+        ok = compiling && cm_program_end(&comp);
     }
 
-    if (cm_program(&comp, &prog, &file_name))
+compiled:
+    if (ok)
         return;
 
     if (args.has_in_path)
@@ -169,14 +276,15 @@ void compile(void) {
 void deinit(void) {
     cm_free(&comp);
     cb_program_free(&prog);
+    ac_close(&cache);
     ps_free(&ps);
-    for (usize i = 0; i < toks.len; i++) {
-        token_free(&toks.data[i]);
-    }
-    av_free(&toks);
+    tokens_free(&toks);
     lx_free(&l);
-    as_free(&file_content);
+    at_free(&atoms);
+    li_free(&lines);
+    sf_free(&file_content);
     as_free(&file_name);
+    as_free(&args.cache_dir);
 }
 
 i32 main(i32 argc, char** argv) {
@@ -9,12 +9,13 @@
  */
 #define _POSIX_C_SOURCE 200809L
 
-#include <ctype.h>
-#include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "../a_string.h"
+#include "../arena.h"
 #include "../ast.h"
 #include "../common.h"
 #include "../lexer.h"
@@ -22,79 +23,6 @@
 #include "parser.h"
 #include "parser_internal.h"
 
-static char resolve_escape(char ch) {
-    switch (ch) {
-        case 'a': {
-            return '\a';
-        } break;
-        case 'b': {
-            return '\b';
-        } break;
-        case 'e': {
-            return '\033';
-        } break;
-        case 'n': {
-            return '\n';
-        } break;
-        case 'r': {
-            return '\r';
-        } break;
-        case 't': {
-            return '\t';
-        } break;
-        case '\\': {
-            return '\\';
-        } break;
-        case '\'': {
-            return '\'';
-        } break;
-        case '"': {
-            return '\"';
-        } break;
-        default: return -1;
-    }
-}
-
-bool is_int(a_string* s) {
-    if (!isdigit(as_first(s)))
-        return false;
-
-    char ch;
-    for (usize i = 1; i < s->len; ++i) {
-        ch = as_at(s, i);
-        if (!isdigit(ch) && ch != '_')
-            return false;
-    }
-
-    return true;
-}
-
-bool is_real(a_string* s) {
-    if (!isdigit(as_first(s)) && as_first(s) != '.')
-        return false;
-
-    if (is_int(s))
-        return false;
-
-    bool found = false;
-    char ch;
-    // starting from 0 because the first item might be a '.'
-    for (usize i = 0; i < s->len; ++i) {
-        ch = as_at(s, i);
-        if (ch == '.') {
-            if (found)
-                return false;
-            found = true;
-            continue;
-        }
-
-        if (!isdigit(ch) && ch != '_')
-            return false;
-    }
-
-    return true;
-}
-
 bool is_literal(TokenKind k) {
     switch (k) {
         case TOK_NULL:
@@ -119,121 +47,99 @@ bool parse_literal(Parser* ps) {
         return false;
     }
 
-    a_string* s = &t->data.string;
+    // the number, string or char literal, pointing into the source
+    const char* s = &ps->src[t->data.slice.offset];
+    usize len = t->data.slice.len;
     switch (t->kind) {
         case TOK_NULL: {
-            ps->expr = cb_expr_new_literal(t->pos, cb_value_new_null());
+            ps->expr =
+                cb_expr_new_literal(&ps->exprs, t->pos, cb_value_new_null());
             return true;
         } break;
         case TOK_LITERAL_NUMBER: {
-            if (is_real(s)) {
-                double res;
-                usize eidx = 0;
-                if ((eidx = as_to_double(s, &res)) != s->len) {
-                    if (errno == ERANGE) {
-                        diag_token(t,
-                                   "float literal \"%.*s\" is either too large "
-                                   "or too small!",
-                                   as_fmtp(s));
-                        return false;
-                    }
-
+            // already decoded by the lexer
+            const Number* n = &t->number;
+            switch (n->kind) {
+                case NUM_INTEGER: {
+                    ps->expr = cb_expr_new_literal(
+                        &ps->exprs, t->pos, cb_value_new_integer(n->integer));
+                    return true;
+                } break;
+                case NUM_REAL: {
+                    ps->expr = cb_expr_new_literal(&ps->exprs, t->pos,
+                                                   cb_value_new_real(n->real));
+                    return true;
+                } break;
+                case NUM_OUT_OF_RANGE: {
+                    const char* what = memchr(s, '.', len) ? "float" : "int";
+                    diag_token(t,
+                               "%s literal \"%.*s\" is either too large or "
+                               "too small!",
+                               what, (int)len, s);
+                    return false;
+                } break;
+                case NUM_INVALID: {
                     Pos p = t->pos;
-                    p.col += eidx;
-                    p.span -= eidx;
-                    ps_diag_at(ps, p, "float literal \"%.*s\" is invalid!",
-                               as_fmtp(s));
+                    p.offset += n->end;
+                    p.span -= n->end;
+                    ps_diag_at(ps, p, "int literal \"%.*s\" is invalid!",
+                               (int)len, s);
                     return false;
-                }
-                ps->expr = cb_expr_new_literal(t->pos, cb_value_new_real(res));
-                return true;
-            } else if (is_int(s)) {
-                int64_t res;
-                usize eidx = 0;
-                if ((eidx = as_to_integer(s, &res, 0)) != s->len) {
-                    if (errno == ERANGE) {
-                        ps_diag_at(ps, t->pos,
-                                   "int literal \"%s\" is either too large or "
-                                   "too small!",
-                                   s->data);
-                        return false;
-                    } else {
-                        Pos p = t->pos;
-                        p.col += eidx;
-                        p.span -= eidx;
-                        ps_diag_at(ps, p, "int literal \"%s\" is invalid!",
-                                   s->data);
-                        return false;
-                    }
-                }
-                ps->expr =
-                    cb_expr_new_literal(t->pos, cb_value_new_integer(res));
-                return true;
-            } else {
-                diag_token(t, "found invalid number literal \"%.*s\"",
-                           as_fmtp(s));
-                return false;
+                } break;
             }
         } break;
         case TOK_LITERAL_BOOLEAN: {
             ps->expr = cb_expr_new_literal(
-                t->pos, cb_value_new_boolean(t->data.boolean));
+                &ps->exprs, t->pos, cb_value_new_boolean(t->data.boolean));
             return true;
         } break;
         case TOK_LITERAL_STRING: {
-            a_string res = as_with_capacity(s->len + 1);
-            char ch;
-            for (usize i = 0; i < s->len; i++) {
-                ch = as_at(s, i);
-
-                if (ch == '\\') {
-                    if (i == s->len - 1) {
-                        diag_token(
-                            t, "last character of string literal is an escape");
-                        as_free(&res);
-                        return false;
-                    }
-
-                    ch = resolve_escape(as_at(s, ++i));
-                    if (ch == -1) {
-                        diag_token(t,
-                                   "invalid escape sequence in string literal");
-                        as_free(&res);
-                        return false;
-                    }
-                }
-
-                as_append_char(&res, ch);
+            // the lexer already checked the escapes
+            if (t->escapes == ESC_INVALID) {
+                diag_token(t, "invalid escape sequence in string literal");
+                return false;
             }
-            ps->expr = cb_expr_new_literal(t->pos, cb_value_new_string(res));
-            as_free(&res);
+
+            char* res = ar_alloc(&ps->arena, len + 1);
+            usize res_len = len;
+            if (t->escapes == ESC_NONE)
+                memcpy(res, s, len);
+            else
+                res_len = lx_unescape(res, s, len);
+            res[res_len] = '\0';
+
+            ps->expr = cb_expr_new_literal(
+                &ps->exprs, t->pos, cb_value_new_arena_string(res, res_len));
             return true;
         } break;
         case TOK_LITERAL_CHAR: {
-            if (s->len == 0) {
+            if (len == 0) {
                 diag_token(t, "not enough characters in character literal");
                 return false;
             }
 
             char ch;
-            if (as_at(s, 0) == '\\') {
-                if (s->len == 1) {
+            if (s[0] == '\\') {
+                if (len == 1) {
                     diag_token(t, "invalid escape in character literal");
                     return false;
                 }
 
-                if ((ch = resolve_escape(as_at(s, 1))) == -1) {
+                i32 esc = lx_escape(s[1]);
+                if (esc == -1) {
                     diag_token(t, "invalid escape in character literal");
                     return false;
                 }
-            } else if (s->len >= 2) {
+                ch = esc;
+            } else if (len >= 2) {
                 diag_token(t, "character literal is too long!");
                 return false;
             } else {
-                ch = as_at(s, 0);
+                ch = s[0];
             }
 
-            ps->expr = cb_expr_new_literal(t->pos, cb_value_new_char(ch));
+            ps->expr =
+                cb_expr_new_literal(&ps->exprs, t->pos, cb_value_new_char(ch));
             return true;
         } break;
         default: return false;
@@ -244,27 +150,31 @@ bool parse_literal(Parser* ps) {
 
 bool parse_primary(Parser* ps) {
     if (ps_check(ps, TOK_LPAREN)) {
-        Token* t = ps_consume(ps);
+        Pos p = ps_consume(ps)->pos;
         if (!ps_expr(ps)) {
-            diag_token(t, "invalid expression inside grouping");
+            ps_diag_at(ps, p, "invalid expression inside grouping");
         }
-        ps->expr = cb_expr_new_unary(t->pos, CB_EXPR_GROUPING, ps->expr);
+        ps->expr =
+            cb_expr_new_unary(&ps->exprs, p, CB_EXPR_GROUPING, ps->expr);
         if (!ps_consume_and_expect(ps, TOK_RPAREN)) {
             return false; // XXX: are we sure we reported it?
         }
         return true;
     }
 
+    // only an error from this literal counts, not one from an earlier
+    // statement
+    u32 errors = ps->error_count;
     if (parse_literal(ps)) {
         return true;
     } else {
-        if (ps->error_count)
+        if (ps->error_count != errors)
             return false;
     }
 
     if (ps_check(ps, TOK_IDENT)) {
         Token* p = ps_consume(ps);
-        ps->expr = cb_expr_new_ident(p->pos, p->data.string);
+        ps->expr = cb_expr_new_ident(&ps->exprs, p->pos, p->atom);
         return true;
     }
 
@@ -299,8 +209,9 @@ bool parse_postfix(Parser* ps) {
         return false;
     }
 
+    Pos begin = peek->pos;
     if (!parse_primary(ps)) {
-        ps_diag_at(ps, peek->pos, "could not parse primary expression");
+        ps_diag_at(ps, begin, "could not parse primary expression");
         return false;
     }
 
@@ -320,19 +231,22 @@ bool parse_postfix(Parser* ps) {
                     goto done;
                 } else {
                     (void)ps_consume(ps);
-                    ps->expr = cb_expr_new_unary(ps_get_pos(ps), CB_EXPR_DEREF,
-                                                 ps->expr);
+                    ps->expr = cb_expr_new_unary(&ps->exprs, ps_get_pos(ps),
+                                                 CB_EXPR_DEREF, ps->expr);
                 }
             } break;
             case TOK_LPAREN: {
                 // TODO: function call
-            } break;
+                goto done;
+            }
             case TOK_LBRACKET: {
                 // TODO: array index
-            } break;
+                goto done;
+            }
             case TOK_DOT: {
                 // TODO: struct access
-            } break;
+                goto done;
+            }
             default: goto done;
         }
     } while (1);
@@ -354,7 +268,9 @@ bool parse_unary(Parser* ps) {
         return false;
 
     // prefix ops
-    switch (t->kind) {
+    TokenKind kind = t->kind;
+    bool prefixed = false;
+    switch (kind) {
         case TOK_SUB:
         case TOK_CARET:
         case TOK_NOT:
@@ -362,19 +278,22 @@ bool parse_unary(Parser* ps) {
             Pos p = ps_consume(ps)->pos;
             if (!parse_unary(ps)) {
                 ps_diag(ps, "could not parse expression after %s",
-                        token_kind_string(t->kind));
+                        token_kind_string(kind));
                 return false;
             }
-            ps->expr = cb_expr_new_unary(p, UNARY_OP_TABLE[t->kind], ps->expr);
+            ps->expr = cb_expr_new_unary(&ps->exprs, p, UNARY_OP_TABLE[kind],
+                                         ps->expr);
+            prefixed = true;
         } break;
         default: break;
     }
 
     // if we still have tokens to postfix
-    if (!ps->eof && can_start_primary_unary(ps_peek(ps)->kind))
+    Token* next = ps->eof ? NULL : ps_peek(ps);
+    if (next && can_start_primary_unary(next->kind))
         return parse_postfix(ps);
-    else // assume everything OK
-        return true;
+    else // fine if we parsed a prefix op, otherwise nothing was parsed
+        return prefixed;
 
     // we probably hit EOF
     return false;
@@ -407,23 +326,21 @@ bool parse_binary(Parser* ps, u8 min_prec) {
     if (!parse_unary(ps))
         return false;
 
-    CB_Expr left = ps->expr;
-    Token* peek = {0};
+    CB_ExprId left = ps->expr;
     TokenKind kind = {0};
     u8 cur_prec = 0;
 
-    while ((peek = ps_peek(ps)) &&
-           (cur_prec = PRECS[(kind = peek->kind)]) != 0 &&
-           PRECS[kind] >= min_prec) {
+    while ((cur_prec = PRECS[(kind = ps_peek_kind(ps))]) != 0 &&
+           cur_prec >= min_prec) {
 
-        (void)ps_consume(ps);
+        Pos op_pos = ps_consume(ps)->pos;
         u8 right_prec = right_assoc(kind) ? cur_prec : cur_prec + 1;
         if (!parse_binary(ps, right_prec))
             return false;
 
         // the newly parsed rhs sohuld be in ps->expr
-        left = cb_expr_new_binary(peek->pos, BINARY_OP_TABLE[kind], left,
-                                  ps->expr);
+        left = cb_expr_new_binary(&ps->exprs, op_pos, BINARY_OP_TABLE[kind],
+                                  left, ps->expr);
     }
 
     ps->expr = left;
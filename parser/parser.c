@@ -12,17 +12,77 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../a_string.h"
+#include "../a_vector.h"
+#include "../arena.h"
 #include "../common.h"
 #include "../lexer.h"
 #include "../lexer_types.h"
 #include "parser.h"
 #include "parser_internal.h"
 
+static void ps_pull(Parser* ps) {
+    Token* t = lx_next_token(ps->lexer);
+    if (!t) {
+        ps_diag_at(ps, ps->lexer->error.pos, "%s",
+                   lx_strerror(ps->lexer->error.kind));
+        ps->lexer_done = true;
+        ps->lexer_error = true;
+        return;
+    }
+
+    // like the token array, the EOF token itself is never handed out
+    if (t->kind == TOK_EOF) {
+        ps->lexer_done = true;
+        return;
+    }
+
+    ps->ring[ps->ring_end++ & (PS_LOOKAHEAD - 1)] = *t;
+}
+
+// unpacks a token from the array into the ring, unless it already is
+static Token* ps_unpack(Parser* ps, usize idx) {
+    usize slot = idx & (PS_LOOKAHEAD - 1);
+    if (ps->ring_idx[slot] != idx + 1) {
+        ps->ring[slot] = tokens_get(ps->tokens, idx);
+        ps->ring_idx[slot] = idx + 1;
+    }
+    return &ps->ring[slot];
+}
+
+// NULL if past the end of the tokens
+static Token* ps_at(Parser* ps, usize idx) {
+    if (!ps->lexer)
+        return idx < ps->tokens_len ? ps_unpack(ps, idx) : NULL;
+
+    while (!ps->lexer_done && ps->ring_end <= idx)
+        ps_pull(ps);
+
+    if (idx >= ps->ring_end)
+        return NULL;
+
+    if (ps->ring_end - idx > PS_LOOKAHEAD)
+        panic("token %zu has already left the lookahead buffer", idx);
+
+    return &ps->ring[idx & (PS_LOOKAHEAD - 1)];
+}
+
+// the last token that is not EOF, if any
+static Token* ps_last(Parser* ps) {
+    if (!ps->lexer)
+        return ps->tokens_len > 0 ? ps_unpack(ps, ps->tokens_len - 1) : NULL;
+
+    return ps->ring_end > 0 ? &ps->ring[(ps->ring_end - 1) & (PS_LOOKAHEAD - 1)]
+                            : NULL;
+}
+
 Token* ps_consume(Parser* ps) {
-    if (IN_BOUNDS) {
-        return &ps->tokens[ps->cur++];
+    Token* t = ps_at(ps, ps->cur);
+    if (t) {
+        ps->cur++;
+        return t;
     } else {
         ps->eof = true;
         return NULL;
@@ -30,39 +90,31 @@ Token* ps_consume(Parser* ps) {
 }
 
 Token* ps_peek(Parser* ps) {
-    if (IN_BOUNDS) {
-        return &ps->tokens[ps->cur];
-    } else {
+    Token* t = ps_at(ps, ps->cur);
+    if (!t)
         ps->eof = true;
-        return NULL;
-    }
+    return t;
 }
 
 Token* ps_peek_next(Parser* ps) {
-    if (ps->cur + 1 < ps->tokens_len) {
-        return &ps->tokens[ps->cur + 1];
-    } else {
+    Token* t = ps_at(ps, ps->cur + 1);
+    if (!t)
         ps->eof = true;
-        return NULL;
-    }
+    return t;
 }
 
 Token* ps_prev(Parser* ps) {
-    if (ps->cur - 1 < ps->tokens_len) {
-        return &ps->tokens[ps->cur - 1];
-    } else {
+    Token* t = ps->cur > 0 ? ps_at(ps, ps->cur - 1) : NULL;
+    if (!t)
         ps->eof = true;
-        return NULL;
-    }
+    return t;
 }
 
 Token* ps_get(Parser* ps, usize idx) {
-    if (idx < ps->tokens_len) {
-        return &ps->tokens[idx];
-    } else {
+    Token* t = ps_at(ps, idx);
+    if (!t)
         ps->eof = true;
-        return NULL;
-    }
+    return t;
 }
 
 Token* ps_peek_and_expect(Parser* ps, TokenKind expected) {
@@ -86,12 +138,22 @@ Token* ps_peek_and_expect(Parser* ps, TokenKind expected) {
     return NULL;
 }
 
-bool ps_check(Parser* ps, TokenKind expected) {
-    Token* t = ps_peek(ps);
-    if (t) {
-        return t->kind == expected;
+TokenKind ps_peek_kind(Parser* ps) {
+    // the array only needs its kinds looked at, not a whole token unpacked
+    if (!ps->lexer) {
+        if (ps->cur < ps->tokens_len)
+            return ps->tokens->kinds[ps->cur];
+
+        ps->eof = true;
+        return TOK_EOF;
     }
-    return false;
+
+    Token* t = ps_peek(ps);
+    return t ? t->kind : TOK_EOF;
+}
+
+bool ps_check(Parser* ps, TokenKind expected) {
+    return ps_peek_kind(ps) == expected;
 }
 
 Token* ps_check_and_consume(Parser* ps, TokenKind expected) {
@@ -107,8 +169,9 @@ Token* ps_consume_and_expect(Parser* ps, TokenKind expected) {
     Token* t = ps_consume(ps);
     if (t) {
         if (t->kind != expected) {
-            ps_diag(ps, "expected token \"%s\" but got \"%s\"", expected_s,
-                    token_kind_string(t->kind));
+            // the token is already consumed, so point at it directly
+            ps_diag_at(ps, t->pos, "expected token \"%s\" but got \"%s\"",
+                       expected_s, token_kind_string(t->kind));
         } else {
             return t;
         }
@@ -126,41 +189,56 @@ Pos ps_get_pos(Parser* ps) {
         return t->pos;
     }
 
-    if (ps->tokens_len > 0)
-        return ps->tokens[ps->tokens_len - 1].pos;
+    if ((t = ps_last(ps)))
+        return t->pos;
 
-    return (Pos){
-        .col = 1,
-        .row = 1,
-    };
+    return (Pos){0};
 }
 
-void ps_diag_at(Parser* ps, Pos pos, const char* format, ...) {
-    eprintf("\033[31;1merror: \033[0;1m%.*s:%u:%u: \033[0m",
-            (int)ps->file_name.len, ps->file_name.data, pos.row, pos.col);
+static void ps_vdiag(Parser* ps, Pos pos, const char* format, va_list args) {
+    if (ps->lexer_error)
+        return;
 
-    va_list args;
-    va_start(args, format);
+    if (ps->diags) {
+        va_list copy;
+        va_copy(copy, args);
+        int len = vsnprintf(NULL, 0, format, copy);
+        va_end(copy);
+
+        a_string msg = as_with_capacity(len + 1);
+        vsnprintf(msg.data, len + 1, format, args);
+        msg.len = len;
+        av_append(ps->diags, ((PsDiag){pos, msg}));
+        ps->error_count++;
+        return;
+    }
+
+    LineCol lc = li_locate(ps->lines, pos.offset);
+    eprintf("\033[31;1merror: \033[0;1m%.*s:%u:%u: \033[0m",
+            (int)ps->file_name.len, ps->file_name.data, lc.row, lc.col);
     vfprintf(stderr, format, args);
-    va_end(args);
     fputc('\n', stderr);
+    li_print_span(ps->lines, pos);
 
     ps->error_count++;
 }
 
+void ps_diag_at(Parser* ps, Pos pos, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    ps_vdiag(ps, pos, format, args);
+    va_end(args);
+}
+
 void ps_diag(Parser* ps, const char* format, ...) {
-    Pos pos = ps_get_pos(ps);
-    // FIXME: less code duplication due to va_list
-    eprintf("\033[31;1merror: \033[0;1m%.*s:%u:%u: \033[0m",
-            (int)ps->file_name.len, ps->file_name.data, pos.row, pos.col);
+    // looking for the position could pull more tokens
+    if (ps->lexer_error)
+        return;
 
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    ps_vdiag(ps, ps_get_pos(ps), format, args);
     va_end(args);
-    fputc('\n', stderr);
-
-    ps->error_count++;
 }
 
 void ps_diag_expected(Parser* ps, const char* thing) {
@@ -174,14 +252,28 @@ void ps_diag_expected(Parser* ps, const char* thing) {
     ps_diag(ps, "expected %s, but found no token", thing);
 }
 
-Parser ps_new(Token* tokens, usize tokens_len, a_string file_name) {
-    if (tokens_len < 1)
+Parser ps_new(const Tokens* toks, LineIndex* lines, a_string file_name) {
+    if (toks->len < 1)
         panic("invalid token length (missing EOF token)");
 
-    return (Parser){
-        .tokens = tokens, .tokens_len = tokens_len - 1, .file_name = file_name};
+    return (Parser){.tokens = toks,
+                    .tokens_len = toks->len - 1,
+                    .src = lines->src,
+                    .lines = lines,
+                    .atoms = toks->atoms,
+                    .file_name = file_name};
+}
+
+Parser ps_new_with_lexer(Lexer* l, LineIndex* lines, a_string file_name) {
+    return (Parser){.lexer = l,
+                    .src = l->src,
+                    .lines = lines,
+                    .atoms = l->atoms,
+                    .file_name = file_name};
 }
 
 void ps_free(Parser* ps) {
     as_free(&ps->file_name);
+    cb_exprs_free(&ps->exprs);
+    ar_free(&ps->arena);
 }
@@ -11,31 +11,105 @@
 #ifndef _PARSER_H
 #define _PARSER_H
 
+#include "../a_string.h"
+#include "../a_vector.h"
+#include "../arena.h"
 #include "../ast.h"
 #include "../common.h"
+#include "../lexer.h"
 #include "../lexer_types.h"
+#include "../lines.h"
 
 #define MAX_ERROR_COUNT 20
 
+// a diagnostic that was kept instead of printed
 typedef struct {
-    Token* tokens;
-    usize tokens_len;
+    Pos pos;
+    a_string msg;
+} PsDiag;
+
+AV_DECL(PsDiag, PsDiags)
+
+// must be a power of two. the parser never looks further than one token
+// behind or one token ahead.
+#define PS_LOOKAHEAD 4
+
+typedef struct {
+    const Tokens* tokens;
+    usize tokens_len; // not counting EOF
+    // when set, tokens are pulled from here instead of the tokens array.
+    // only the last PS_LOOKAHEAD tokens are kept around.
+    Lexer* lexer;
+    // holds the unpacked tokens in either mode
+    Token ring[PS_LOOKAHEAD];
+    // in array mode, index + 1 of the token unpacked into each ring slot
+    usize ring_idx[PS_LOOKAHEAD];
+    usize ring_end; // number of tokens pulled so far
+    bool lexer_done;
+    // set once the lexer reports an error. anything reported after that
+    // would just be noise from the broken token stream.
+    bool lexer_error;
+    // source buffer the token slices point into
+    const char* src;
+    // for showing where diagnostics are
+    LineIndex* lines;
+    // when set, diagnostics are kept in here instead of printed, so that they
+    // can be printed later in the right order. lines is not touched then.
+    PsDiags* diags;
+    // table the identifier atoms come from
+    const AtomTable* atoms;
     a_string file_name;
     usize cur;
+    // the expressions are made in here, and everything else is allocated from
+    // the arena. ps_program hands both over to the program, and otherwise they
+    // live as long as the parser.
+    CB_Exprs exprs;
+    Arena arena;
     // used as return values
     CB_Stmt stmt;
-    CB_Expr expr;
+    CB_ExprId expr;
     u32 error_count;
     // eof marker
     bool eof;
 } Parser;
 
-// requires toks to be a valid pointer, ownership of file_name will be taken
-Parser ps_new(Token* toks, usize tokens_len, a_string file_name);
+// requires toks and lines to be valid pointers that outlive the parser, and
+// lines to index the source the tokens came from. ownership of file_name will
+// be taken
+Parser ps_new(const Tokens* toks, LineIndex* lines, a_string file_name);
+// requires l and lines to be valid pointers that outlive the parser, and lines
+// to index the lexer's source. ownership of file_name will be taken
+Parser ps_new_with_lexer(Lexer* l, LineIndex* lines, a_string file_name);
 void ps_free(Parser* ps);
 
 bool ps_expr(Parser* ps);
 bool ps_stmt(Parser* ps);
+// parses the next top level statement into ps->stmt, skipping over any that
+// fail to parse. returns false at the end of the tokens, or once there are too
+// many errors. the statement lives in ps->exprs and ps->arena, which can be
+// reset once the statement is done with.
+bool ps_next_stmt(Parser* ps);
 bool ps_program(Parser* ps, CB_Program* out);
 
+// the fewest tokens a thread is given. a piece also costs merging its
+// expressions into the program and replaying its diagnostics, on the calling
+// thread.
+#define PS_CHUNK_MIN (64 * 1024)
+
+// like ps_program, but splits the tokens at newlines into pieces of top level
+// statements, and parses them on up to jobs threads (0 for one per cpu). the
+// program and the diagnostics are exactly the same as ps_program's. few
+// tokens, or a parser made with ps_new_with_lexer, are parsed on the calling
+// thread.
+bool ps_program_parallel(Parser* ps, CB_Program* out, u32 jobs);
+// how many threads ps_program_parallel would really use
+u32 ps_parallel_jobs(const Parser* ps, u32 jobs);
+
+// updates prog, parsed from the old tokens, after lx_relex made edit to them.
+// only the statements that could have seen the edit are parsed again, and the
+// rest are kept. ps must be made with ps_new over the updated tokens. the
+// nodes of the replaced statements stay in prog until it is freed. on
+// a parse error, prog is freed and false is returned.
+bool ps_reparse(Parser* ps, CB_Program* prog, TokenEdit edit);
+
 #endif // _PARSER_H
@@ -15,6 +15,9 @@
 #include "parser.h"
 
 // utility functions
+//
+// the returned tokens are only guaranteed to stay valid until the parser
+// advances, so copy out whatever is needed after parsing something else.
 Token* ps_peek(Parser* ps);
 Token* ps_consume(Parser* ps);
 Token* ps_prev(Parser* ps);
@@ -23,6 +26,8 @@ Token* ps_get(Parser* ps, usize idx);
 Token* ps_peek_and_expect(Parser* ps, TokenKind expected);
 Token* ps_check_and_consume(Parser* ps, TokenKind expected);
 Token* ps_consume_and_expect(Parser* ps, TokenKind expected);
+// TOK_EOF if there are no tokens left
+TokenKind ps_peek_kind(Parser* ps);
 bool ps_check(Parser* ps, TokenKind expected);
 Pos ps_get_pos(Parser* ps);
 void ps_diag(Parser* ps, const char* format, ...);
@@ -38,6 +43,4 @@ bool parse_binary(Parser* ps, u8 min_prec);
 
 #define diag_token(t, ...) ps_diag_at(ps, (t)->pos, __VA_ARGS__)
 
-#define IN_BOUNDS (ps->cur < ps->tokens_len)
-
 #endif // _PARSER_INTERNAL_H
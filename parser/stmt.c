@@ -9,14 +9,21 @@
  */
 #define _POSIX_C_SOURCE 200809L
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "../arena.h"
 #include "../lexer.h"
 #include "parser.h"
 #include "parser_internal.h"
 
-AV_DECL(CB_Expr, Exprs)
+AV_DECL(CB_ExprId, ExprIds)
 
 void ps_skip_past_newline(Parser* ps) {
-    while (!ps->eof && ps_check(ps, TOK_NEWLINE))
+    while (!ps->eof && !ps_check(ps, TOK_NEWLINE))
         ps_consume(ps);
     // eat the last newline
     if (!ps->eof)
@@ -24,13 +31,13 @@ void ps_skip_past_newline(Parser* ps) {
 }
 
 static bool ps_output_stmt(Parser* ps) {
-    Token* begin = NULL;
-    Exprs exprs = {0};
+    Token begin = {0};
+    ExprIds exprs = {0};
 
     if (!ps_check(ps, TOK_OUTPUT) && !ps_check(ps, TOK_PRINT))
         return false;
 
-    begin = ps_consume(ps);
+    begin = *ps_consume(ps);
     if (ps_check(ps, TOK_NEWLINE))
         goto end;
     // call above it sets eof
@@ -39,7 +46,7 @@ static bool ps_output_stmt(Parser* ps) {
 
     if (!ps_expr(ps)) {
         ps_diag(ps, "could not parse expression after %s",
-                token_kind_string(begin->kind));
+                token_kind_string(begin.kind));
         goto fail;
     } else {
         av_append(&exprs, ps->expr);
@@ -64,9 +71,9 @@ static bool ps_output_stmt(Parser* ps) {
     // TCC fix
     CB_OutputStmt output_stmt = {0};
 end:
-    // move Exprs over to OutputStmt
-    output_stmt = cb_output_stmt_new(exprs.data, exprs.len);
-    ps->stmt = cb_stmt_new_output(begin->pos, output_stmt);
+    output_stmt = cb_output_stmt_new(&ps->arena, exprs.data, exprs.len);
+    av_free(&exprs);
+    ps->stmt = cb_stmt_new_output(begin.pos, output_stmt);
     return true;
 fail:
     av_free(&exprs);
@@ -74,18 +81,136 @@ fail:
 }
 
 static bool ps_input_stmt(Parser* ps) {
-    Token* begin = NULL;
+    Token* t = NULL;
 
-    if (!(begin = ps_check_and_consume(ps, TOK_INPUT)))
+    if (!(t = ps_check_and_consume(ps, TOK_INPUT)))
         return false;
 
+    Pos begin = t->pos;
     if (!ps_expr(ps)) {
-        ps_diag_at(ps, begin->pos, "could not parse expression after INPUT");
+        ps_diag_at(ps, begin, "could not parse expression after INPUT");
         return false;
     }
 
     CB_InputStmt input_stmt = cb_input_stmt_new(ps->expr);
-    ps->stmt = cb_stmt_new_input(begin->pos, input_stmt);
+    ps->stmt = cb_stmt_new_input(begin, input_stmt);
+    return true;
+}
+
+AV_DECL(Atom, Names)
+
+static bool ps_type(Parser* ps, CB_Type* out) {
+    switch (ps_peek_kind(ps)) {
+        case TOK_INTEGER: *out = CB_PRIM_INTEGER; break;
+        case TOK_REAL: *out = CB_PRIM_REAL; break;
+        case TOK_BOOLEAN: *out = CB_PRIM_BOOLEAN; break;
+        case TOK_CHAR: *out = CB_PRIM_CHAR; break;
+        case TOK_STRING: *out = CB_PRIM_STRING; break;
+        default: {
+            // TODO: arrays and custom types
+            ps_diag_expected(ps, "a primitive type");
+            return false;
+        }
+    }
+
+    (void)ps_consume(ps);
+    return true;
+}
+
+// DECLARE a, b: TYPE
+static bool ps_declare_stmt(Parser* ps, Pos begin, bool exported) {
+    Names names = {0};
+
+    do {
+        Token* t = ps_peek_and_expect(ps, TOK_IDENT);
+        if (!t)
+            goto fail;
+        av_append(&names, t->atom);
+        (void)ps_consume(ps);
+    } while (ps_check_and_consume(ps, TOK_COMMA));
+
+    if (names.len > UINT16_MAX) {
+        ps_diag_at(ps, begin, "too many names in one DECLARE");
+        goto fail;
+    }
+
+    if (!ps_consume_and_expect(ps, TOK_COLON))
+        goto fail;
+
+    CB_Type type;
+    if (!ps_type(ps, &type))
+        goto fail;
+
+    CB_DeclareStmt declare = cb_declare_stmt_new(&ps->arena, names.data,
+                                                 names.len, type, exported);
+    av_free(&names);
+    ps->stmt = cb_stmt_new_declare(begin, declare);
+    return true;
+fail:
+    av_free(&names);
+    return false;
+}
+
+// CONSTANT name <- value
+static bool ps_constant_stmt(Parser* ps, Pos begin, bool exported) {
+    Token* t = ps_peek_and_expect(ps, TOK_IDENT);
+    if (!t)
+        return false;
+    Atom name = t->atom;
+    (void)ps_consume(ps);
+
+    if (!ps_consume_and_expect(ps, TOK_ASSIGN))
+        return false;
+
+    if (!ps_expr(ps)) {
+        ps_diag_at(ps, begin, "could not parse the value of the constant");
+        return false;
+    }
+
+    CB_ConstantStmt constant = cb_constant_stmt_new(name, ps->expr, exported);
+    ps->stmt = cb_stmt_new_constant(begin, constant);
+    return true;
+}
+
+// the statements that declare something, maybe after EXPORT
+static bool ps_decl_stmt(Parser* ps) {
+    Token* t = ps_peek(ps);
+    if (!t)
+        return false;
+
+    Pos begin = t->pos;
+    bool exported = false;
+    if (t->kind == TOK_EXPORT) {
+        exported = true;
+        (void)ps_consume(ps);
+        t = ps_peek(ps);
+        if (!t || (t->kind != TOK_DECLARE && t->kind != TOK_CONSTANT)) {
+            ps_diag_expected(ps, "DECLARE or CONSTANT after EXPORT");
+            return false;
+        }
+    }
+
+    switch (t->kind) {
+        case TOK_DECLARE: {
+            (void)ps_consume(ps);
+            return ps_declare_stmt(ps, begin, exported);
+        } break;
+        case TOK_CONSTANT: {
+            (void)ps_consume(ps);
+            return ps_constant_stmt(ps, begin, exported);
+        } break;
+        default: return false;
+    }
+}
+
+static bool ps_scope_stmt(Parser* ps) {
+    TokenKind k = ps_peek_kind(ps);
+    if (k != TOK_SCOPE && k != TOK_ENDSCOPE)
+        return false;
+
+    Pos begin = ps_consume(ps)->pos;
+    ps->stmt = cb_stmt_new_marker(
+        begin, k == TOK_SCOPE ? CB_STMT_SCOPE : CB_STMT_ENDSCOPE);
     return true;
 }
 
@@ -95,53 +220,460 @@ bool ps_stmt(Parser* ps) {
         return false;
     }
 
+    // a statement that was recognized but failed to parse has already
+    // reported its errors, so don't try to parse it as something else
+    u32 errors = ps->error_count;
+
     if (ps_output_stmt(ps))
         return true;
+    else if (ps->error_count != errors)
+        return false;
 
     if (ps_input_stmt(ps))
         return true;
+    else if (ps->error_count != errors)
+        return false;
+
+    if (ps_decl_stmt(ps))
+        return true;
+    else if (ps->error_count != errors)
+        return false;
+
+    if (ps_scope_stmt(ps))
+        return true;
 
     if (ps_expr(ps)) {
-        ps->stmt = cb_stmt_new_expr(ps->expr.pos, ps->expr);
+        CB_ExprId target = ps->expr;
+        Pos begin = ps->exprs.pos[target];
+        if (!ps_check_and_consume(ps, TOK_ASSIGN)) {
+            ps->stmt = cb_stmt_new_expr(begin, target);
+            return true;
+        }
+
+        if (!ps_expr(ps)) {
+            ps_diag_at(ps, begin, "could not parse the value to assign");
+            return false;
+        }
+
+        CB_AssignStmt assign = cb_assign_stmt_new(target, ps->expr);
+        ps->stmt = cb_stmt_new_assign(begin, assign);
         return true;
     }
 
-    if (!ps->eof)
-        ps_diag(ps, "unexpected token %s",
-                token_kind_string(ps_peek(ps)->kind));
+    // the expression could have run into the end of the tokens
+    Token* t = ps_peek(ps);
+    if (t)
+        ps_diag(ps, "unexpected token %s", token_kind_string(t->kind));
+    else
+        ps_diag(ps, "unexpected end of file");
 
     return false;
 }
 
+// everything a statement made, so that a failed one can be thrown away
+typedef struct {
+    usize exprs;
+    ArenaMark arena;
+} PsMark;
+
+static PsMark ps_mark(Parser* ps) {
+    return (PsMark){ps->exprs.len, ar_mark(&ps->arena)};
+}
+
+static void ps_rewind(Parser* ps, PsMark mark) {
+    cb_exprs_truncate(&ps->exprs, mark.exprs);
+    ar_rewind(&ps->arena, mark.arena);
+}
+
+bool ps_next_stmt(Parser* ps) {
+    while (true) {
+        while (ps_check(ps, TOK_NEWLINE))
+            (void)ps_consume(ps);
+
+        if (ps->eof)
+            return false;
+
+        // whatever a failed statement allocated is thrown away with it
+        PsMark mark = ps_mark(ps);
+        bool ok = ps_stmt(ps);
+        if (!ok) {
+            ps_rewind(ps, mark);
+            ps_skip_past_newline(ps);
+        }
+
+        if (ps->error_count > MAX_ERROR_COUNT) {
+            ps_diag(ps, "too many errors reported, stopping now.");
+            return false;
+        }
+
+        if (ok)
+            return true;
+    }
+}
+
 AV_DECL(CB_Stmt, Stmts)
+AV_DECL(CB_TokenRange, TokenRanges)
+
+// parses top level statements until the end of the tokens. when reparsing
+// after edit, it stops as soon as the next statement is one of old's that the
+// edit did not touch, leaving its index in *reuse.
+static bool ps_stmts(Parser* ps, Stmts* s, TokenRanges* r,
+                     const CB_Program* old, const TokenEdit* edit,
+                     usize* reuse) {
+    while (true) {
+        while (ps_check(ps, TOK_NEWLINE))
+            (void)ps_consume(ps);
+
+        if (ps->eof)
+            break;
+
+        // statements look one token behind, so that one must be untouched too
+        if (old && ps->cur > edit->new_end) {
+            usize was = ps->cur - edit->new_end + edit->old_end;
+            while (*reuse < old->len && old->ranges[*reuse].begin < was)
+                (*reuse)++;
+
+            if (*reuse < old->len && old->ranges[*reuse].begin == was)
+                return true;
+        }
+
+        CB_TokenRange range = {.begin = ps->cur};
+        PsMark mark = ps_mark(ps);
+        if (ps_stmt(ps)) {
+            range.end = ps->cur;
+            av_append(s, ps->stmt);
+            av_append(r, range);
+        } else {
+            ps_rewind(ps, mark);
+            ps_skip_past_newline(ps);
+        }
+
+        if (ps->error_count > MAX_ERROR_COUNT) {
+            ps_diag(ps, "too many errors reported, stopping now.");
+            return false;
+        }
+    }
+
+    if (old)
+        *reuse = old->len;
+    return true;
+}
 
 bool ps_program(Parser* ps, CB_Program* out) {
     Stmts s = {0};
+    TokenRanges r = {0};
+
+    if (!ps_stmts(ps, &s, &r, NULL, NULL, NULL) || ps->error_count)
+        goto fail;
+
+    *out = cb_program_new(s.data, r.data, s.len, ps->exprs, ps->arena,
+                          ps->atoms);
+    ps->exprs = (CB_Exprs){0};
+    ps->arena = (Arena){0};
+    return true;
+fail:
+    av_free(&s);
+    av_free(&r);
+    cb_exprs_truncate(&ps->exprs, 0);
+    ar_reset(&ps->arena);
+    return false;
+}
+
+#define PS_MAX_JOBS 64
+
+// where a chunk's diagnostics stand after each statement, so that the limit
+// on errors can be checked at the same points as ps_stmts does
+typedef struct {
+    usize cur;
+    usize diags;
+} PsStep;
+
+AV_DECL(PsStep, PsSteps)
+
+typedef struct {
+    const Parser* parent;
+    Parser ps;
+    usize begin;
+    usize end;  // just past a newline, or the end of the tokens
+    usize stop; // where parsing actually stopped
+    Stmts stmts;
+    TokenRanges ranges;
+    PsSteps steps;
+    PsDiags diags;
+} PsChunk;
+
+// parses from begin until the statements reach end. a statement that runs
+// into end could have gone differently with the tokens after it, so unless
+// end is the real end, it is thrown away and parsing stops before it. the
+// rest matches what ps_stmts does, as long as it would also have started a
+// statement at begin.
+static void ps_parse_chunk(PsChunk* c) {
+    const Parser* parent = c->parent;
+    c->ps = (Parser){.tokens = parent->tokens,
+                     .tokens_len = c->end,
+                     .src = parent->src,
+                     .lines = parent->lines,
+                     .diags = &c->diags,
+                     .atoms = parent->atoms,
+                     .cur = c->begin};
+    Parser* ps = &c->ps;
+    bool last = c->end == parent->tokens_len;
 
     while (true) {
-        if (ps_check(ps, TOK_NEWLINE))
+        while (ps_check(ps, TOK_NEWLINE))
             (void)ps_consume(ps);
 
         if (ps->eof)
             break;
 
-        if (ps_stmt(ps))
-            av_append(&s, ps->stmt);
-        else
+        CB_TokenRange range = {.begin = ps->cur};
+        PsMark mark = ps_mark(ps);
+        usize diags = c->diags.len;
+        u32 errors = ps->error_count;
+
+        bool ok = ps_stmt(ps);
+        if (!ok)
             ps_skip_past_newline(ps);
 
-        if (ps->error_count > MAX_ERROR_COUNT) {
-            ps_diag(ps, "too many errors reported, stopping now.");
-            goto fail;
+        if (ps->eof && !last) {
+            ps_rewind(ps, mark);
+            while (c->diags.len > diags)
+                as_free(&c->diags.data[--c->diags.len].msg);
+            ps->error_count = errors;
+            ps->cur = range.begin;
+            break;
+        }
+
+        if (ok) {
+            range.end = ps->cur;
+            av_append(&c->stmts, ps->stmt);
+            av_append(&c->ranges, range);
+        } else {
+            ps_rewind(ps, mark);
+        }
+
+        av_append(&c->steps, ((PsStep){ps->cur, c->diags.len}));
+
+        // the errors before this chunk only add to these, so the limit is
+        // hit by this step at the latest
+        if (ps->error_count > MAX_ERROR_COUNT)
+            break;
+    }
+
+    c->stop = ps->cur;
+}
+
+static int ps_chunk_worker(void* arg) {
+    ps_parse_chunk(arg);
+    return 0;
+}
+
+static void ps_chunk_free(PsChunk* c) {
+    for (usize i = 0; i < c->diags.len; i++)
+        as_free(&c->diags.data[i].msg);
+    av_free(&c->diags);
+    av_free(&c->steps);
+    av_free(&c->stmts);
+    av_free(&c->ranges);
+    cb_exprs_free(&c->ps.exprs);
+    ar_free(&c->ps.arena);
+}
+
+u32 ps_parallel_jobs(const Parser* ps, u32 jobs) {
+    if (ps->lexer)
+        return 1;
+
+    if (jobs == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = n > 0 ? n : 1;
+    }
+
+    usize rest = ps->tokens_len - ps->cur;
+    if (jobs > rest / PS_CHUNK_MIN)
+        jobs = rest / PS_CHUNK_MIN;
+    if (jobs > PS_MAX_JOBS)
+        jobs = PS_MAX_JOBS;
+
+    return jobs;
+}
+
+bool ps_program_parallel(Parser* ps, CB_Program* out, u32 jobs) {
+    jobs = ps_parallel_jobs(ps, jobs);
+    usize rest = ps->tokens_len - ps->cur;
+    if (jobs < 2)
+        return ps_program(ps, out);
+
+    // split roughly evenly, just after a newline token. every top level
+    // statement ends at one, but not every one ends a statement, so a chunk
+    // can start in the middle of one. that is fixed up below.
+    const u8* kinds = ps->tokens->kinds;
+    PsChunk chunks[PS_MAX_JOBS];
+    u32 nchunks = 0;
+    usize begin = ps->cur;
+    for (usize i = ps->cur; i + 1 < ps->tokens_len && nchunks + 1 < jobs;
+         i++) {
+        usize want = ps->cur + rest * (nchunks + 1) / jobs;
+        if (kinds[i] != TOK_NEWLINE || i + 1 < want)
+            continue;
+
+        chunks[nchunks++] = (PsChunk){
+            .parent = ps,
+            .begin = begin,
+            .end = i + 1,
+        };
+        begin = i + 1;
+    }
+    chunks[nchunks++] = (PsChunk){
+        .parent = ps,
+        .begin = begin,
+        .end = ps->tokens_len,
+    };
+
+    thrd_t threads[PS_MAX_JOBS];
+    bool spawned[PS_MAX_JOBS] = {0};
+    for (u32 i = 1; i < nchunks; i++)
+        spawned[i] = thrd_create(&threads[i], ps_chunk_worker, &chunks[i]) ==
+                     thrd_success;
+
+    ps_parse_chunk(&chunks[0]);
+    for (u32 i = 1; i < nchunks; i++) {
+        if (spawned[i])
+            thrd_join(threads[i], NULL);
+        else
+            ps_parse_chunk(&chunks[i]);
+    }
+
+    // diagnostics are printed here, in order, by ps itself
+    Stmts s = {0};
+    TokenRanges r = {0};
+    bool ok = true;
+    for (u32 i = 0; i < nchunks; i++) {
+        PsChunk* c = &chunks[i];
+        if (!ok) {
+            ps_chunk_free(c);
+            continue;
+        }
+
+        if (c->begin != ps->cur) {
+            // the chunk before stopped short of its split point, so this one
+            // started in the middle of a statement. parse it again from the
+            // right place.
+            ps_chunk_free(c);
+            *c = (PsChunk){.parent = ps, .begin = ps->cur, .end = c->end};
+            ps_parse_chunk(c);
+        }
+
+        usize d = 0;
+        for (usize j = 0; j < c->steps.len && ok; j++) {
+            for (; d < c->steps.data[j].diags; d++)
+                ps_diag_at(ps, c->diags.data[d].pos, "%.*s",
+                           as_fmt(c->diags.data[d].msg));
+
+            if (ps->error_count > MAX_ERROR_COUNT) {
+                ps->cur = c->steps.data[j].cur;
+                ps_diag(ps, "too many errors reported, stopping now.");
+                ok = false;
+            }
+        }
+
+        CB_ExprId base = cb_exprs_append(&ps->exprs, &c->ps.exprs);
+        for (usize j = 0; j < c->stmts.len; j++) {
+            cb_stmt_rebase(&c->stmts.data[j], base);
+            av_append(&s, c->stmts.data[j]);
+            av_append(&r, c->ranges.data[j]);
         }
+        ar_adopt(&ps->arena, &c->ps.arena);
+
+        ps->cur = c->stop;
+        ps_chunk_free(c);
     }
 
-    if (ps->error_count)
+    if (!ok || ps->error_count)
         goto fail;
 
-    *out = cb_program_new(s.data, s.len);
+    *out = cb_program_new(s.data, r.data, s.len, ps->exprs, ps->arena,
+                          ps->atoms);
+    ps->exprs = (CB_Exprs){0};
+    ps->arena = (Arena){0};
     return true;
 fail:
     av_free(&s);
+    av_free(&r);
+    cb_exprs_truncate(&ps->exprs, 0);
+    ar_reset(&ps->arena);
     return false;
 }
+
+bool ps_reparse(Parser* ps, CB_Program* prog, TokenEdit edit) {
+    if (ps->lexer)
+        panic("reparsing needs the whole token array");
+
+    // a statement also looks up to two tokens past its end, so the first one
+    // to parse again is the first that could have seen the edit
+    usize first = 0, hi = prog->len;
+    while (first < hi) {
+        usize mid = first + (hi - first) / 2;
+        if (prog->ranges[mid].end + 1 < edit.begin)
+            first = mid + 1;
+        else
+            hi = mid;
+    }
+
+    Stmts s = {0};
+    TokenRanges r = {0};
+    usize reuse = first;
+    ps->cur = first > 0 ? prog->ranges[first - 1].end : 0;
+
+    // the new statements go straight into the program
+    CB_Exprs own_exprs = ps->exprs;
+    Arena own_arena = ps->arena;
+    ps->exprs = prog->exprs;
+    ps->arena = prog->arena;
+    bool ok = ps_stmts(ps, &s, &r, prog, &edit, &reuse);
+    prog->exprs = ps->exprs;
+    prog->arena = ps->arena;
+    ps->exprs = own_exprs;
+    ps->arena = own_arena;
+
+    if (!ok || ps->error_count) {
+        av_free(&s);
+        av_free(&r);
+        cb_program_free(prog);
+        *prog = (CB_Program){0};
+        return false;
+    }
+
+    usize tail = prog->len - reuse;
+    usize len = first + s.len + tail;
+    usize cap = len ? len : 1;
+    if (len > prog->len) {
+        prog->stmts = realloc(prog->stmts, cap * sizeof(CB_Stmt));
+        check_alloc(prog->stmts);
+        prog->ranges = realloc(prog->ranges, cap * sizeof(CB_TokenRange));
+        check_alloc(prog->ranges);
+    }
+
+    if (tail && first + s.len != reuse) {
+        memmove(&prog->stmts[first + s.len], &prog->stmts[reuse],
+                tail * sizeof(CB_Stmt));
+        memmove(&prog->ranges[first + s.len], &prog->ranges[reuse],
+                tail * sizeof(CB_TokenRange));
+    }
+    if (s.len) {
+        memcpy(&prog->stmts[first], s.data, s.len * sizeof(CB_Stmt));
+        memcpy(&prog->ranges[first], r.data, s.len * sizeof(CB_TokenRange));
+    }
+
+    // the reused statements come after the edit, so everything in them moved
+    usize moved = edit.new_end - edit.old_end;
+    for (usize i = first + s.len; i < len && (edit.shift || moved); i++) {
+        cb_stmt_shift(&prog->exprs, &prog->stmts[i], edit.shift);
+        prog->ranges[i].begin += moved;
+        prog->ranges[i].end += moved;
+    }
+
+    prog->len = len;
+    av_free(&s);
+    av_free(&r);
+    return true;
+}
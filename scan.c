@@ -0,0 +1,307 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+
+#include "common.h"
+#include "scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+// matches isspace() in the C locale, minus the newline
+#define IS_BLANK(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r' && (c) != '\n'))
+
+// scalar versions, also used for the tails of the vector loops
+
+static usize scan_blanks_from(const char* s, usize i, usize len) {
+    while (i < len && IS_BLANK(s[i]))
+        i++;
+    return i;
+}
+
+static usize scan_delim_from(const char* s, usize i, usize len, char delim) {
+    while (i < len && s[i] != delim && s[i] != '\\')
+        i++;
+    return i;
+}
+
+static usize scan_comment_end_from(const char* s, usize i, usize len) {
+    for (; i < len; i++) {
+        if (s[i] == '*' && i + 1 < len && s[i + 1] == '/')
+            return i;
+    }
+
+    return len;
+}
+
+static usize scan_count_newlines_from(const char* s, usize i, usize len) {
+    usize res = 0;
+    for (; i < len; i++)
+        res += s[i] == '\n';
+    return res;
+}
+
+static void scan_find_newlines_from(const char* s, usize i, usize len,
+                                    u32* out) {
+    for (; i < len; i++) {
+        if (s[i] == '\n')
+            *out++ = i;
+    }
+}
+
+#ifdef SCAN_X86
+
+// stores the indices of the bits set in mask, for a block starting at i
+#define EMIT_BITS(mask, i, out)                                                \
+    do {                                                                       \
+        while ((mask)) {                                                       \
+            *(out)++ = (i) + __builtin_ctz((mask));                            \
+            (mask) &= (mask) - 1;                                              \
+        }                                                                      \
+    } while (0)
+
+__attribute__((target("sse2"))) static usize scan_blanks_sse2(const char* s,
+                                                              usize len) {
+    const __m128i sp = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'),
+                  vt = _mm_set1_epi8('\v'), ff = _mm_set1_epi8('\f'),
+                  cr = _mm_set1_epi8('\r');
+    usize i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, vt),
+                                      _mm_cmpeq_epi8(v, ff)),
+                         _mm_cmpeq_epi8(v, cr)));
+        u32 mask = ~(u32)_mm_movemask_epi8(m) & 0xFFFF;
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return scan_blanks_from(s, i, len);
+}
+
+__attribute__((target("avx2"))) static usize scan_blanks_avx2(const char* s,
+                                                              usize len) {
+    const __m256i sp = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t'),
+                  vt = _mm256_set1_epi8('\v'), ff = _mm256_set1_epi8('\f'),
+                  cr = _mm256_set1_epi8('\r');
+    usize i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&s[i]);
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                            _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, vt),
+                                            _mm256_cmpeq_epi8(v, ff)),
+                            _mm256_cmpeq_epi8(v, cr)));
+        u32 mask = ~(u32)_mm256_movemask_epi8(m);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return scan_blanks_from(s, i, len);
+}
+
+__attribute__((target("sse2"))) static usize
+scan_delim_sse2(const char* s, usize len, char delim) {
+    const __m128i d = _mm_set1_epi8(delim), bs = _mm_set1_epi8('\\');
+    usize i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+        u32 mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, d), _mm_cmpeq_epi8(v, bs)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return scan_delim_from(s, i, len, delim);
+}
+
+__attribute__((target("avx2"))) static usize
+scan_delim_avx2(const char* s, usize len, char delim) {
+    const __m256i d = _mm256_set1_epi8(delim), bs = _mm256_set1_epi8('\\');
+    usize i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&s[i]);
+        u32 mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, d), _mm256_cmpeq_epi8(v, bs)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+
+    return scan_delim_from(s, i, len, delim);
+}
+
+__attribute__((target("sse2"))) static usize
+scan_comment_end_sse2(const char* s, usize len) {
+    const __m128i star = _mm_set1_epi8('*'), slash = _mm_set1_epi8('/');
+    usize i = 0;
+
+    // one extra byte is needed for the shifted load
+    for (; i + 17 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+        __m128i next = _mm_loadu_si128((const __m128i*)&s[i + 1]);
+        u32 end = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v, star),
+                                                  _mm_cmpeq_epi8(next, slash)));
+        if (end)
+            return i + __builtin_ctz(end);
+    }
+
+    return scan_comment_end_from(s, i, len);
+}
+
+__attribute__((target("avx2"))) static usize
+scan_comment_end_avx2(const char* s, usize len) {
+    const __m256i star = _mm256_set1_epi8('*'), slash = _mm256_set1_epi8('/');
+    usize i = 0;
+
+    // one extra byte is needed for the shifted load
+    for (; i + 33 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&s[i]);
+        __m256i next = _mm256_loadu_si256((const __m256i*)&s[i + 1]);
+        u32 end = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(v, star), _mm256_cmpeq_epi8(next, slash)));
+        if (end)
+            return i + __builtin_ctz(end);
+    }
+
+    return scan_comment_end_from(s, i, len);
+}
+
+__attribute__((target("sse2"))) static usize
+scan_count_newlines_sse2(const char* s, usize len) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    usize i = 0, res = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+        res += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    }
+
+    return res + scan_count_newlines_from(s, i, len);
+}
+
+__attribute__((target("avx2"))) static usize
+scan_count_newlines_avx2(const char* s, usize len) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    usize i = 0, res = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&s[i]);
+        res += __builtin_popcount(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+    }
+
+    return res + scan_count_newlines_from(s, i, len);
+}
+
+__attribute__((target("sse2"))) static void
+scan_find_newlines_sse2(const char* s, usize len, u32* out) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    usize i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+        u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        EMIT_BITS(mask, i, out);
+    }
+
+    scan_find_newlines_from(s, i, len, out);
+}
+
+__attribute__((target("avx2"))) static void
+scan_find_newlines_avx2(const char* s, usize len, u32* out) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    usize i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&s[i]);
+        u32 mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        EMIT_BITS(mask, i, out);
+    }
+
+    scan_find_newlines_from(s, i, len, out);
+}
+
+#endif // SCAN_X86
+
+usize scan_blanks(const char* s, usize len) {
+    // most runs are a single space, which is not worth a vector load
+    if (len == 0 || !IS_BLANK(s[0]))
+        return 0;
+    if (len == 1 || !IS_BLANK(s[1]))
+        return 1;
+
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2"))
+        return scan_blanks_avx2(s, len);
+    if (__builtin_cpu_supports("sse2"))
+        return scan_blanks_sse2(s, len);
+#endif
+
+    return scan_blanks_from(s, 0, len);
+}
+
+usize scan_delim(const char* s, usize len, char delim) {
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2"))
+        return scan_delim_avx2(s, len, delim);
+    if (__builtin_cpu_supports("sse2"))
+        return scan_delim_sse2(s, len, delim);
+#endif
+
+    return scan_delim_from(s, 0, len, delim);
+}
+
+usize scan_comment_end(const char* s, usize len) {
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2"))
+        return scan_comment_end_avx2(s, len);
+    if (__builtin_cpu_supports("sse2"))
+        return scan_comment_end_sse2(s, len);
+#endif
+
+    return scan_comment_end_from(s, 0, len);
+}
+
+usize scan_count_newlines(const char* s, usize len) {
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2"))
+        return scan_count_newlines_avx2(s, len);
+    if (__builtin_cpu_supports("sse2"))
+        return scan_count_newlines_sse2(s, len);
+#endif
+
+    return scan_count_newlines_from(s, 0, len);
+}
+
+void scan_find_newlines(const char* s, usize len, u32* out) {
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        scan_find_newlines_avx2(s, len, out);
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        scan_find_newlines_sse2(s, len, out);
+        return;
+    }
+#endif
+
+    scan_find_newlines_from(s, 0, len, out);
+}
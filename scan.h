@@ -0,0 +1,36 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _SCAN_H
+#define _SCAN_H
+
+#include "common.h"
+
+// byte scanning kernels used by the lexer. on x86 they work 16 or 32 bytes at
+// a time with SSE2 or AVX2, picked at runtime; elsewhere they are plain loops.
+// none of them read past s[len - 1].
+
+// number of leading blanks in s: spaces, tabs, \v, \f and \r, the same bytes
+// the lexer skips as blanks, but not newlines.
+usize scan_blanks(const char* s, usize len);
+
+// index of the first byte in s that is either delim or a backslash, or len.
+usize scan_delim(const char* s, usize len, char delim);
+
+// index of the first "*/" in s, or len if there is none.
+usize scan_comment_end(const char* s, usize len);
+
+// number of newlines in s.
+usize scan_count_newlines(const char* s, usize len);
+
+// stores the index of every newline in s into out, which needs room for
+// scan_count_newlines(s, len) of them.
+void scan_find_newlines(const char* s, usize len, u32* out);
+
+#endif // _SCAN_H
@@ -0,0 +1,120 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // madvise
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "a_string.h"
+#include "common.h"
+#include "source.h"
+
+#define SF_READ_CHUNK 65536
+// releasing is a syscall, so only bother once this much more can go
+#define SF_RELEASE_CHUNK (1024 * 1024)
+
+bool sf_read_fd(int fd, SourceFile* out) {
+    a_string buf = as_with_capacity(SF_READ_CHUNK);
+
+    while (true) {
+        if (buf.cap - buf.len < SF_READ_CHUNK)
+            as_reserve(&buf, buf.cap * 2);
+
+        // keep one byte for the null terminator
+        isize got = read(fd, &buf.data[buf.len], buf.cap - buf.len - 1);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+
+            int saved = errno;
+            as_free(&buf);
+            errno = saved;
+            return false;
+        }
+
+        if (got == 0)
+            break;
+
+        buf.len += got;
+    }
+
+    buf.data[buf.len] = '\0';
+    *out = (SourceFile){.data = buf.data, .len = buf.len, .buf = buf};
+    return true;
+}
+
+bool sf_open(const char* path, SourceFile* out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+
+    // the rest of the last page of a mapping reads as zeroes, which gives us
+    // the null terminator for free. if the file fills its last page exactly,
+    // there is no room for one, so it gets read instead.
+    usize size = st.st_size;
+    long page = sysconf(_SC_PAGESIZE);
+    if (S_ISREG(st.st_mode) && size > 0 && page > 0 && size % page != 0) {
+        void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            (void)posix_madvise(p, size, POSIX_MADV_SEQUENTIAL);
+            close(fd);
+            *out = (SourceFile){.data = p, .len = size, .mapped = true};
+            return true;
+        }
+    }
+
+    bool res = sf_read_fd(fd, out);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return res;
+}
+
+void sf_release(SourceFile* sf, usize upto) {
+    if (!sf->mapped || upto > sf->len)
+        return;
+
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0)
+        return;
+
+    upto -= upto % page;
+    if (upto < sf->released + SF_RELEASE_CHUNK)
+        return;
+
+    // the mapping is private and never written to, so the pages can just be
+    // dropped and faulted back in from the file
+    (void)madvise((void*)(sf->data + sf->released), upto - sf->released,
+                  MADV_DONTNEED);
+    sf->released = upto;
+}
+
+void sf_free(SourceFile* sf) {
+    if (sf->mapped) {
+        if (sf->data)
+            munmap((void*)sf->data, sf->len);
+    } else {
+        as_free(&sf->buf);
+    }
+
+    *sf = (SourceFile){0};
+}
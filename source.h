@@ -0,0 +1,41 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _SOURCE_H
+#define _SOURCE_H
+
+#include <stdbool.h>
+
+#include "a_string.h"
+#include "common.h"
+
+// a read-only source buffer, either mapped straight from the file or read
+// into memory. the data is always followed by a null terminator.
+typedef struct {
+    const char* data;
+    usize len;
+    bool mapped;
+    usize released; // bytes given back by sf_release
+    a_string buf;   // only valid if not mapped
+} SourceFile;
+
+// maps regular files, and reads anything else (pipes, FIFOs). returns false
+// and leaves errno set on failure.
+bool sf_open(const char* path, SourceFile* out);
+// reads everything from fd until EOF. returns false and leaves errno set on
+// failure.
+bool sf_read_fd(int fd, SourceFile* out);
+// tells the os that the bytes before upto will not be needed again soon, so
+// a mapped source does not have to stay resident as it is read through. the
+// data stays valid, and is read back from the file if it is touched again.
+// does nothing for sources that were read into memory.
+void sf_release(SourceFile* sf, usize upto);
+void sf_free(SourceFile* sf);
+
+#endif // _SOURCE_H
@@ -0,0 +1,99 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "a_vector.h"
+#include "atom.h"
+#include "common.h"
+#include "hashtab.h"
+#include "symbols.h"
+
+#define SY_INITIAL_SLOTS 256
+
+SymbolTable sy_new(void) {
+    return (SymbolTable){.names = ht_new(SY_INITIAL_SLOTS)};
+}
+
+void sy_free(SymbolTable* t) {
+    av_free(&t->symbols);
+    av_free(&t->scopes);
+    ht_free(&t->names);
+    av_free(&t->innermost);
+    *t = (SymbolTable){0};
+}
+
+// atoms are dense, and multiplying by an odd number never maps two of them
+// to the same hash, so the hashes are all that has to be compared
+static inline u32 sy_hash(Atom a) {
+    return a * 2654435761u;
+}
+
+// the entry of the name in innermost, or SY_NONE. *slot is set to its slot,
+// or the empty one it would go in.
+static u32 sy_find(const SymbolTable* t, u32 hash, u32* slot) {
+    const HashTable* h = &t->names;
+    u32 i = ht_start(h, hash);
+    while (!ht_empty(h, i) && ht_hash(h, i) != hash)
+        i = ht_next(h, i);
+
+    *slot = i;
+    return ht_empty(h, i) ? SY_NONE : ht_id(h, i);
+}
+
+void sy_enter(SymbolTable* t) {
+    av_append(&t->scopes, (u32)t->symbols.len);
+}
+
+void sy_leave(SymbolTable* t) {
+    u32 mark = av_pop(&t->scopes, 0);
+
+    // newest first, so that a name shadowed twice in the scope gets back
+    // what it was before the scope
+    for (usize i = t->symbols.len; i-- > mark;) {
+        const Symbol* s = &t->symbols.data[i];
+        u32 slot;
+        u32 n = sy_find(t, sy_hash(s->name), &slot);
+        t->innermost.data[n] = s->shadowed;
+    }
+
+    t->symbols.len = mark;
+}
+
+u32 sy_declare(SymbolTable* t, Symbol s, u32* dup) {
+    u32 slot, hash = sy_hash(s.name);
+    u32 n = sy_find(t, hash, &slot);
+    u32 cur = n == SY_NONE ? SY_NONE : t->innermost.data[n];
+
+    if (cur != SY_NONE && t->symbols.data[cur].depth == sy_depth(t)) {
+        *dup = cur;
+        return SY_NONE;
+    }
+
+    s.depth = sy_depth(t);
+    s.shadowed = cur;
+    u32 res = t->symbols.len;
+    av_append(&t->symbols, s);
+
+    if (n == SY_NONE) {
+        ht_insert(&t->names, slot, hash, t->innermost.len);
+        av_append(&t->innermost, res);
+    } else {
+        t->innermost.data[n] = res;
+    }
+
+    return res;
+}
+
+u32 sy_lookup(const SymbolTable* t, Atom name) {
+    u32 slot;
+    u32 n = sy_find(t, sy_hash(name), &slot);
+    return n == SY_NONE ? SY_NONE : t->innermost.data[n];
+}
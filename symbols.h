@@ -0,0 +1,81 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include <stdbool.h>
+
+#include "a_vector.h"
+#include "ast.h"
+#include "atom.h"
+#include "common.h"
+#include "hashtab.h"
+
+typedef enum {
+    SY_VARIABLE = 0,
+    SY_CONSTANT,
+} SymbolKind;
+
+// not a symbol
+#define SY_NONE ((u32)-1)
+
+typedef struct {
+    Atom name;
+    SymbolKind kind;
+    CB_Type type;
+    u32 depth;    // of the scope it was declared in, 0 for globals
+    u32 shadowed; // the symbol with the same name it hides, or SY_NONE
+    u64 id;       // whatever the user of the table keeps for it
+    // of a constant, if it is known before the program runs. CB_PRIM_NULL
+    // otherwise.
+    CB_Value value;
+    Pos pos;
+    bool exported; // to the enclosing scope, when its own is left
+} Symbol;
+
+AV_DECL(Symbol, Symbols)
+AV_DECL(u32, SymbolMarks)
+AV_DECL(u32, SymbolIds)
+
+// every name that was ever declared has one entry in innermost, found through
+// a hash table, holding its innermost symbol. the symbols themselves are kept
+// in the order they were declared, so leaving a scope is just popping the
+// ones declared since it was entered, and putting back what each of them hid.
+typedef struct {
+    Symbols symbols;    // indexed by symbol, in declaration order
+    SymbolMarks scopes; // symbols.len when each open scope was entered
+    HashTable names;    // of the entries in innermost, by the hash of the name
+    // by name, in the order they were first declared. a name keeps its entry
+    // when it goes out of scope, with SY_NONE in it.
+    SymbolIds innermost;
+} SymbolTable;
+
+SymbolTable sy_new(void);
+void sy_free(SymbolTable* t);
+
+void sy_enter(SymbolTable* t);
+// forgets every symbol declared since the matching sy_enter
+void sy_leave(SymbolTable* t);
+// 0 while no scope was entered
+#define sy_depth(t) ((u32)(t)->scopes.len)
+// the first symbol declared in the current scope, which must not be the
+// global one
+#define sy_scope_start(t) ((t)->scopes.data[(t)->scopes.len - 1])
+
+// adds s in the current scope, and returns its index. s.depth and s.shadowed
+// are filled in. if the name was already declared in the same scope, nothing
+// is added and that symbol is returned in *dup, with SY_NONE returned.
+u32 sy_declare(SymbolTable* t, Symbol s, u32* dup);
+// the innermost symbol with this name, or SY_NONE. valid until the scope it
+// was declared in is left.
+u32 sy_lookup(const SymbolTable* t, Atom name);
+#define sy_get(t, i) (&(t)->symbols.data[(i)])
+
+#endif // _SYMBOLS_H
@@ -0,0 +1,171 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// lexes the same sources on many threads at once, each with lexers and atom
+// tables of its own, and checks that every result is exactly what lexing
+// them one at a time gives.
+//
+// usage: lexer_threads FILE...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "../a_string.h"
+#include "../atom.h"
+#include "../common.h"
+#include "../lexer.h"
+#include "../source.h"
+
+#define THREADS 16
+#define ROUNDS  8
+
+typedef struct {
+    AtomTable atoms;
+    Tokens toks;
+    LexerError error; // if it did not lex
+    bool ok;
+} Lexed;
+
+typedef struct {
+    u32 index;
+    u32 failures;
+} Worker;
+
+// shared by every thread, and only read once they are started
+static SourceFile* sources;
+static char** paths;
+static Lexed* expected;
+static usize count;
+
+static void lex(const SourceFile* f, Lexed* out) {
+    out->atoms = at_new();
+    Lexer l = lx_new(f->data, f->len, &out->atoms);
+    out->ok = lx_tokenize(&l, &out->toks);
+    out->error = l.error;
+    lx_free(&l);
+}
+
+static void lexed_free(Lexed* x) {
+    tokens_free(&x->toks);
+    at_free(&x->atoms);
+}
+
+static bool same_numbers(const Numbers* a, const Numbers* b) {
+    if (a->len != b->len)
+        return false;
+
+    for (usize i = 0; i < a->len; i++) {
+        const Number *x = &a->data[i], *y = &b->data[i];
+        // integer covers every byte of the union
+        if (x->kind != y->kind || x->len != y->len || x->integer != y->integer)
+            return false;
+    }
+
+    return true;
+}
+
+// the atoms are compared as numbers, so the tables must have been filled in
+// the same order as well
+static bool same_atoms(const AtomTable* a, const AtomTable* b) {
+    return a->entries.len == b->entries.len && a->text.len == b->text.len &&
+           memcmp(a->text.data, b->text.data, a->text.len) == 0;
+}
+
+static bool same(const Lexed* a, const Lexed* b) {
+    if (a->ok != b->ok)
+        return false;
+    if (!a->ok)
+        return a->error.kind == b->error.kind &&
+               a->error.pos.offset == b->error.pos.offset;
+
+    const Tokens *x = &a->toks, *y = &b->toks;
+    usize n = x->len;
+    return n == y->len && memcmp(x->kinds, y->kinds, n) == 0 &&
+           memcmp(x->offsets, y->offsets, n * sizeof(u32)) == 0 &&
+           memcmp(x->lens, y->lens, n * sizeof(u16)) == 0 &&
+           memcmp(x->payloads, y->payloads, n * sizeof(u32)) == 0 &&
+           same_numbers(&x->numbers, &y->numbers) &&
+           same_atoms(&a->atoms, &b->atoms);
+}
+
+static int worker(void* arg) {
+    Worker* w = arg;
+
+    // every thread starts at a different source, so that different ones are
+    // being lexed at the same time too
+    for (u32 round = 0; round < ROUNDS; round++) {
+        for (usize i = 0; i < count; i++) {
+            usize j = (i + w->index) % count;
+            Lexed got = {0};
+            lex(&sources[j], &got);
+            if (!same(&got, &expected[j])) {
+                eprintf("thread %u: %s lexed differently\n", w->index,
+                        paths[j]);
+                w->failures++;
+            }
+            lexed_free(&got);
+        }
+    }
+
+    return 0;
+}
+
+i32 main(i32 argc, char** argv) {
+    if (argc < 2) {
+        eprintf("usage: %s FILE...\n", argv[0]);
+        return 2;
+    }
+
+    count = argc - 1;
+    paths = &argv[1];
+    sources = calloc(count, sizeof(SourceFile));
+    check_alloc(sources);
+    expected = calloc(count, sizeof(Lexed));
+    check_alloc(expected);
+
+    for (usize i = 0; i < count; i++) {
+        if (!sf_open(paths[i], &sources[i])) {
+            eprintf("could not read %s\n", paths[i]);
+            return 2;
+        }
+        lex(&sources[i], &expected[i]);
+    }
+
+    thrd_t threads[THREADS];
+    Worker workers[THREADS] = {0};
+    for (u32 i = 0; i < THREADS; i++) {
+        workers[i].index = i;
+        if (thrd_create(&threads[i], worker, &workers[i]) != thrd_success)
+            panic("could not start thread %u", i);
+    }
+
+    u32 failures = 0;
+    for (u32 i = 0; i < THREADS; i++) {
+        thrd_join(threads[i], NULL);
+        failures += workers[i].failures;
+    }
+
+    for (usize i = 0; i < count; i++) {
+        lexed_free(&expected[i]);
+        sf_free(&sources[i]);
+    }
+    free(expected);
+    free(sources);
+
+    if (failures) {
+        eprintf("lexer_threads: %u mismatches\n", failures);
+        return 1;
+    }
+
+    printf("lexer_threads: %zu files on %d threads ok\n", count, THREADS);
+    return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ * cbc: a cursed bean(code) compiler
+ *
+ * Copyright (c) Eason Qin <eason@ezntek.com>, 2026.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// makes random edits to a source, keeps its tokens and program up to date
+// with lx_relex and ps_reparse, and checks after every edit that they are
+// the same as lexing and parsing the edited source from scratch.
+//
+// usage: reparse [EDITS [SEED]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../a_string.h"
+#include "../ast.h"
+#include "../atom.h"
+#include "../common.h"
+#include "../lexer.h"
+#include "../lines.h"
+#include "../parser/parser.h"
+
+#define START_LINES 200
+
+// whole statements, covering every kind there is
+static const char* LINES[] = {
+    "OUTPUT 1, a + 2\n",
+    "OUTPUT \"two\nlines\", (b - 3) * c\n",
+    "INPUT b\n",
+    "DECLARE x, y: INTEGER\n",
+    "EXPORT DECLARE z: REAL\n",
+    "CONSTANT K <- 3 * 4\n",
+    "EXPORT CONSTANT S <- \"be\" + \"an\"\n",
+    "a <- b - 1\n",
+    "c + (d * 2) ^ 3\n",
+    "SCOPE\n",
+    "ENDSCOPE\n",
+    "\n",
+};
+
+// put in place of some tokens. none of them can start a comment or a string
+// that never ends, or stick to the tokens around them, so few edits make a
+// source that does not lex. those are reported by lx_tokenize, and must not
+// relex either. many more make one that does not parse.
+static const char* SNIPPETS[] = {
+    "",       " 1 ",     " 2.5 ",       " q ",    " + 2 ",   "(",
+    ")",      ",",       "\n",          " <- ",   ":",       " TRUE ",
+    " a ",    " - b ",   " 'c' ",       " \"s\" ", " NOT ",   " = ",
+    " OUTPUT ", " INPUT ", " CONSTANT ", " SCOPE ", " ENDSCOPE ",
+};
+
+#define LEN(a) (sizeof(a) / sizeof(*(a)))
+
+typedef struct {
+    const AtomTable* atoms;
+    const CB_Exprs* exprs;
+} Side;
+
+static bool same_atom(Side a, Atom x, Side b, Atom y) {
+    return strcmp(at_str(a.atoms, x), at_str(b.atoms, y)) == 0;
+}
+
+static bool same_expr(Side a, CB_ExprId x, Side b, CB_ExprId y) {
+    CB_ExprKind k = a.exprs->kinds[x];
+    Pos px = a.exprs->pos[x], py = b.exprs->pos[y];
+    if (k != b.exprs->kinds[y] || px.offset != py.offset || px.span != py.span)
+        return false;
+
+    CB_ExprData dx = a.exprs->data[x], dy = b.exprs->data[y];
+    if (k == CB_EXPR_LIT) {
+        const CB_Value *vx = cb_expr_lit(a.exprs, x);
+        const CB_Value *vy = cb_expr_lit(b.exprs, y);
+        if (vx->kind != vy->kind)
+            return false;
+        switch (vx->kind) {
+            case CB_PRIM_STRING:
+                return vx->string.len == vy->string.len &&
+                       memcmp(vx->string.data, vy->string.data,
+                              vx->string.len) == 0;
+            case CB_PRIM_INTEGER: return vx->integer == vy->integer;
+            case CB_PRIM_REAL: return vx->real == vy->real;
+            case CB_PRIM_BOOLEAN: return vx->boolean == vy->boolean;
+            case CB_PRIM_CHAR: return vx->chr == vy->chr;
+            default: return true;
+        }
+    }
+    if (k == CB_EXPR_IDENT)
+        return same_atom(a, dx.ident, b, dy.ident);
+    if (cb_expr_kind_is_unary(k))
+        return same_expr(a, dx.unary, b, dy.unary);
+    if (cb_expr_kind_is_binary(k))
+        return same_expr(a, dx.lhs, b, dy.lhs) &&
+               same_expr(a, dx.rhs, b, dy.rhs);
+    return true;
+}
+
+static bool same_stmt(Side a, const CB_Stmt* x, Side b, const CB_Stmt* y) {
+    if (x->kind != y->kind || x->pos.offset != y->pos.offset ||
+        x->pos.span != y->pos.span)
+        return false;
+
+    switch (x->kind) {
+        case CB_STMT_EXPR: return same_expr(a, x->expr, b, y->expr);
+        case CB_STMT_OUTPUT: {
+            if (x->output.len != y->output.len)
+                return false;
+            for (usize i = 0; i < x->output.len; i++)
+                if (!same_expr(a, x->output.exprs[i], b, y->output.exprs[i]))
+                    return false;
+            return true;
+        }
+        case CB_STMT_INPUT:
+            return same_expr(a, x->input.target, b, y->input.target);
+        case CB_STMT_DECLARE: {
+            const CB_DeclareStmt *dx = &x->declare, *dy = &y->declare;
+            if (dx->len != dy->len || dx->type != dy->type ||
+                dx->exported != dy->exported)
+                return false;
+            for (usize i = 0; i < dx->len; i++)
+                if (!same_atom(a, dx->names[i], b, dy->names[i]))
+                    return false;
+            return true;
+        }
+        case CB_STMT_CONSTANT:
+            return x->constant.exported == y->constant.exported &&
+                   same_atom(a, x->constant.name, b, y->constant.name) &&
+                   same_expr(a, x->constant.value, b, y->constant.value);
+        case CB_STMT_ASSIGN:
+            return same_expr(a, x->assign.target, b, y->assign.target) &&
+                   same_expr(a, x->assign.value, b, y->assign.value);
+        default: return true;
+    }
+}
+
+static bool same_program(const CB_Program* x, const CB_Program* y) {
+    Side a = {x->atoms, &x->exprs}, b = {y->atoms, &y->exprs};
+    if (x->len != y->len)
+        return false;
+
+    for (usize i = 0; i < x->len; i++) {
+        if (x->ranges[i].begin != y->ranges[i].begin ||
+            x->ranges[i].end != y->ranges[i].end)
+            return false;
+        if (!same_stmt(a, &x->stmts[i], b, &y->stmts[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// the reparsed nodes must be shared just like nodes that were parsed at once
+static bool same_sharing(const CB_Exprs* xs) {
+    CB_Exprs fresh = {0};
+    cb_exprs_share(&fresh);
+    cb_exprs_append(&fresh, xs);
+    bool res = memcmp(fresh.same, xs->same, xs->len * sizeof(CB_ExprId)) == 0;
+    cb_exprs_free(&fresh);
+    return res;
+}
+
+static bool same_tokens(const Tokens* x, const Tokens* y) {
+    if (x->len != y->len)
+        return false;
+
+    for (usize i = 0; i < x->len; i++) {
+        if (x->kinds[i] != y->kinds[i] || x->offsets[i] != y->offsets[i] ||
+            x->lens[i] != y->lens[i])
+            return false;
+        // the two were interned into different tables
+        if (x->kinds[i] == TOK_IDENT
+                ? strcmp(at_str(x->atoms, x->payloads[i]),
+                         at_str(y->atoms, y->payloads[i])) != 0
+                : x->payloads[i] != y->payloads[i])
+            return false;
+    }
+
+    return true;
+}
+
+static void diags_clear(PsDiags* ds) {
+    for (usize i = 0; i < ds->len; i++)
+        as_free(&ds->data[i].msg);
+    ds->len = 0;
+}
+
+// parses toks from scratch, quietly
+static bool parse(const Tokens* toks, LineIndex* lines, PsDiags* diags,
+                  CB_Program* out) {
+    Parser ps = ps_new(toks, lines, astr("(test)"));
+    ps.diags = diags;
+    cb_exprs_share(&ps.exprs);
+    bool ok = ps_program(&ps, out);
+    ps_free(&ps);
+    diags_clear(diags);
+    return ok;
+}
+
+// picks an edit that replaces whole lines or whole tokens. it goes by the
+// tokens rather than the text, so that it never cuts one in half.
+static SourceEdit pick_edit(const Tokens* toks, const char** ins) {
+    // toks ends with EOF, which is never replaced
+    usize first = rand() % toks->len, last = first;
+    if (rand() % 2) {
+        while (first > 0 && toks->kinds[first - 1] != TOK_NEWLINE)
+            first--;
+        // drop up to two lines, or none to only insert one
+        last = first;
+        for (u32 n = rand() % 3; n && last + 1 < toks->len; n--) {
+            while (last + 1 < toks->len && toks->kinds[last] != TOK_NEWLINE)
+                last++;
+            if (last + 1 < toks->len)
+                last++;
+        }
+        *ins = rand() % 4 ? LINES[rand() % LEN(LINES)] : "";
+    } else {
+        last = first + rand() % 3;
+        if (last >= toks->len)
+            last = toks->len - 1;
+        *ins = SNIPPETS[rand() % LEN(SNIPPETS)];
+    }
+
+    return (SourceEdit){
+        .offset = toks->offsets[first],
+        .removed = toks->offsets[last] - toks->offsets[first],
+        .inserted = strlen(*ins),
+    };
+}
+
+i32 main(i32 argc, char** argv) {
+    u32 edits = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    srand(argc > 2 ? strtoul(argv[2], NULL, 10) : 1);
+
+    a_string src = as_new();
+    for (u32 i = 0; i < START_LINES; i++)
+        as_append_cstr(&src, LINES[rand() % LEN(LINES)]);
+
+    AtomTable atoms = at_new();
+    Tokens toks;
+    Lexer l = lx_new(src.data, src.len, &atoms);
+    if (!lx_tokenize(&l, &toks))
+        panic("the starting source does not lex");
+
+    PsDiags diags = {0};
+    LineIndex lines = li_new(src.data, src.len);
+    CB_Program prog = {0};
+    bool have = parse(&toks, &lines, &diags, &prog);
+    li_free(&lines);
+
+    u32 failures = 0, reparsed = 0;
+    for (u32 i = 0; i < edits && !failures; i++) {
+        const char* ins;
+        SourceEdit e = pick_edit(&toks, &ins);
+
+        a_string next = as_slice(&src, 0, e.offset);
+        a_string rest = as_slice(&src, e.offset + e.removed, src.len);
+        as_append_cstr(&next, ins);
+        as_append_astr(&next, &rest);
+        as_free(&rest);
+
+        // what it should come out as
+        AtomTable want_atoms = at_new();
+        Tokens want_toks;
+        l = lx_new(next.data, next.len, &want_atoms);
+        bool want_lexed = lx_tokenize(&l, &want_toks);
+
+        TokenEdit te;
+        l = lx_new(next.data, next.len, &atoms);
+        bool lexed = lx_relex(&l, &toks, e, &te);
+        if (lexed != want_lexed || (lexed && !same_tokens(&toks, &want_toks))) {
+            eprintf("edit %u at %u: relexed tokens differ\n", i, e.offset);
+            failures++;
+        }
+
+        // the edit is undone, as lx_relex left the tokens as they were
+        if (!want_lexed) {
+            tokens_free(&want_toks);
+            at_free(&want_atoms);
+            as_free(&next);
+            continue;
+        }
+
+        lines = li_new(next.data, next.len);
+        CB_Program want = {0};
+        bool want_ok = parse(&want_toks, &lines, &diags, &want);
+
+        // a program that did not parse has nothing to reuse
+        Parser ps = ps_new(&toks, &lines, astr("(test)"));
+        ps.diags = &diags;
+        cb_exprs_share(&ps.exprs);
+        if (have) {
+            have = ps_reparse(&ps, &prog, te);
+            reparsed++;
+        } else {
+            have = ps_program(&ps, &prog);
+        }
+        ps_free(&ps);
+        diags_clear(&diags);
+        li_free(&lines);
+
+        if (have != want_ok) {
+            eprintf("edit %u at %u: reparsing %s, parsing %s\n", i, e.offset,
+                    have ? "worked" : "failed", want_ok ? "worked" : "failed");
+            failures++;
+        } else if (have && (!same_program(&prog, &want) ||
+                            !same_sharing(&prog.exprs))) {
+            eprintf("edit %u at %u: reparsed program differs\n", i, e.offset);
+            failures++;
+        }
+
+        if (want_ok)
+            cb_program_free(&want);
+        tokens_free(&want_toks);
+        at_free(&want_atoms);
+        as_free(&src);
+        src = next;
+    }
+
+    if (have)
+        cb_program_free(&prog);
+    av_free(&diags);
+    tokens_free(&toks);
+    at_free(&atoms);
+    as_free(&src);
+
+    if (failures) {
+        eprintf("reparse: failed\n");
+        return 1;
+    }
+
+    printf("reparse: %u edits ok, %u of them reparsed\n", edits, reparsed);
+    return 0;
+}